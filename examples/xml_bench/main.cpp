@@ -0,0 +1,545 @@
+#include<cstdio>
+#include<cstdlib>
+#include<string>
+#include<chrono>
+
+#include"../../include/xml_parse.h"
+#include"../../include/xml_symbols.h"
+#include"../../include/xml_number.h"
+#include"../../include/xml_base64.h"
+
+// usage instructions (Unix/OS-X)
+// compile with 'g++ -O2 main.cpp -o bench', run with './bench [megabytes] [repeats]'
+//
+// builds a synthetic document in memory by repeating the records found
+// in ../test.xml and reports the throughput of the parser in MB/s
+
+// =========================================================================
+// helper functions
+
+// builds a document of roughly 'megabytes' MB out of <correspondence> records
+void build_document( size_t megabytes, std::string &buffer );
+
+// builds a document of roughly 'megabytes' MB made up of elements holding
+// kilobytes of text each
+void build_text_document( size_t megabytes, std::string &buffer );
+
+// builds a document of roughly 'megabytes' MB made up of elements holding
+// CDATA sections of kilobytes of markup-like payload each
+void build_cdata_document( size_t megabytes, std::string &buffer );
+
+// builds a document of roughly 'megabytes' MB of records interleaved with
+// large commented-out blocks
+void build_comment_document( size_t megabytes, std::string &buffer );
+
+// builds a document of roughly 'megabytes' MB of <correspondence>
+// elements whose text is a long list of comma-separated integers
+void build_array_document( size_t megabytes, std::string &buffer );
+
+// builds a document of roughly 'megabytes' MB of <buffer> elements
+// holding arrays of floats encoded as base64, alternately as text and
+// as CDATA sections
+void build_base64_document( size_t megabytes, std::string &buffer );
+
+// parses 'buffer' 'repeats' times with the callback, templated handler
+// and pull interfaces and prints the throughput of each
+void run_benchmark( const char *label, const std::string &buffer, int repeats, xml_span_callbacks *callbacks );
+
+// parses 'buffer' 'repeats' times skipping every element below the root
+// and prints the throughput, i.e. the cost of a selective read
+void run_skip_benchmark( const char *label, const std::string &buffer, int repeats );
+
+// parses 'buffer' 'repeats' times receiving the attributes of each
+// tag in a single call, with the handler and callback interfaces, and
+// prints the throughput of each
+void run_batch_benchmark( const char *label, const std::string &buffer, int repeats );
+
+// parses 'buffer' 'repeats' times dispatching on the record's tag and
+// attribute names, first by comparing names and then by symbol id, and
+// prints the throughput of each
+void run_symbol_benchmark( const char *label, const std::string &buffer, int repeats );
+
+// parses 'buffer' 'repeats' times converting every attribute value to a
+// double, first with atof() on a copy of the value and then in place
+// with xml_span_to_double(), and prints the throughput of each
+void run_number_benchmark( const char *label, const std::string &buffer, int repeats );
+
+// parses 'buffer' 'repeats' times reading the integer lists in tag text,
+// first with strtol() on a copy of the text and then in place with
+// xml_span_to_int32_vector(), and prints the throughput of each
+void run_array_benchmark( const char *label, const std::string &buffer, int repeats );
+
+// parses 'buffer' 'repeats' times, first only counting events and then
+// decoding the base64 text and CDATA sections into a buffer, and prints
+// the throughput of each
+void run_base64_benchmark( const char *label, const std::string &buffer, int repeats );
+
+// =========================================================================
+// callbacks which do nothing but count events, so that the benchmark
+// measures the parser rather than the consumer
+void count_tag( void *user_data, xml_span name );
+void count_text( void *user_data, xml_span text );
+void count_attribute( void *user_data, xml_span name, xml_span value );
+void count_attributes( void *user_data, xml_span name, const xml_attribute *attributes, size_t count );
+
+// handler doing the same counting through the templated interface, so
+// that the counting is inlined into the parser
+class counting_handler : public xml_handler {
+public:
+    size_t events;
+    counting_handler() : events(0) {}
+    inline void begin_tag( xml_span name ){ events += name.len > 0; }
+    inline void end_tag( xml_span name ){ events += name.len > 0; }
+    inline void tag_text( xml_span text ){ events += text.len > 0; }
+    inline void comment( xml_span comment ){ events += comment.len > 0; }
+    inline void cdata( xml_span text ){ events += text.len > 0; }
+    inline void attribute( xml_span name, xml_span value ){ events += name.len > 0 && value.len > 0; }
+};
+
+// vocabulary of the records, and handlers tallying the attributes of
+// each <c> record by comparing names or by switching on symbol ids
+enum { NAME_CORR, NAME_C, NAME_U, NAME_V, NAME_X, NAME_Y, NAME_Z, NAME_COUNT };
+static const char *record_names[NAME_COUNT] = { "corr", "c", "u", "v", "x", "y", "z" };
+
+class comparing_handler : public xml_handler {
+public:
+    size_t counts[NAME_COUNT+1];
+    comparing_handler(){ memset( counts, 0, sizeof(counts) ); }
+    inline void begin_tag( xml_span name ){
+        if( xml_span_equals( name, "corr" ) ) counts[NAME_CORR]++;
+        else if( xml_span_equals( name, "c" ) ) counts[NAME_C]++;
+        else counts[NAME_COUNT]++;
+    }
+    inline void attribute( xml_span name, xml_span value ){
+        (void)value;
+        if( xml_span_equals( name, "u" ) ) counts[NAME_U]++;
+        else if( xml_span_equals( name, "v" ) ) counts[NAME_V]++;
+        else if( xml_span_equals( name, "x" ) ) counts[NAME_X]++;
+        else if( xml_span_equals( name, "y" ) ) counts[NAME_Y]++;
+        else if( xml_span_equals( name, "z" ) ) counts[NAME_Z]++;
+        else counts[NAME_COUNT]++;
+    }
+};
+
+class symbol_handler : public xml_symbol_handler {
+public:
+    size_t counts[NAME_COUNT+1];
+    symbol_handler(){ memset( counts, 0, sizeof(counts) ); }
+    inline void begin_tag( int id, xml_span name ){ (void)name; counts[id < 0 ? NAME_COUNT : id]++; }
+    inline void attribute( int id, xml_span name, xml_span value ){ (void)name; (void)value; counts[id < 0 ? NAME_COUNT : id]++; }
+};
+
+// handler counting the same events with the attributes of each tag
+// delivered together
+class batch_handler : public counting_handler {
+public:
+    inline void attributes( xml_span name, const xml_attribute *attributes, size_t count ){
+        (void)name;
+        for( size_t i=0; i<count; i++ )
+            events += attributes[i].name.len > 0 && attributes[i].value.len > 0;
+    }
+    inline bool batch_attributes(){ return true; }
+};
+
+// handlers summing every attribute value as a number, converting a
+// string copy with atof() or the span in place
+class atof_handler : public xml_handler {
+public:
+    double sum;
+    atof_handler() : sum( 0.0 ){}
+    inline void attribute( xml_span name, xml_span value ){ (void)name; sum += atof( std::string( value.str, value.len ).c_str() ); }
+};
+
+class number_handler : public xml_handler {
+public:
+    double sum;
+    number_handler() : sum( 0.0 ){}
+    inline void attribute( xml_span name, xml_span value ){
+        (void)name;
+        double number = 0.0;
+        xml_span_to_double( value, &number );
+        sum += number;
+    }
+};
+
+// handlers summing the integer lists in tag text, converting a string
+// copy with strtol() or the span in place
+class strtol_handler : public xml_handler {
+public:
+    int64_t sum;
+    strtol_handler() : sum( 0 ){}
+    inline void tag_text( xml_span text ){
+        std::string copy( text.str, text.len );
+        char *p = &copy[0], *next;
+        for( long value = strtol( p, &next, 10 ); next != p; value = strtol( p, &next, 10 ) ){
+            sum += value;
+            p = *next == ',' ? next+1 : next;
+        }
+    }
+};
+
+class array_handler : public xml_handler {
+public:
+    int64_t sum;
+    std::vector<int32_t> values;
+    array_handler() : sum( 0 ){}
+    inline void tag_text( xml_span text ){
+        values.clear();
+        xml_span_to_int32_vector( text, &values );
+        for( size_t i=0; i<values.size(); i++ )
+            sum += values[i];
+    }
+};
+
+// handler decoding the base64 payloads of text and CDATA sections
+// into a reused buffer and totalling the decoded size
+class base64_handler : public xml_handler {
+public:
+    size_t bytes;
+    std::vector<unsigned char> data;
+    base64_handler() : bytes( 0 ){}
+    inline void tag_text( xml_span text ){ decode( text ); }
+    inline void cdata( xml_span text ){ decode( text ); }
+    inline void decode( xml_span text ){
+        data.clear();
+        xml_base64_decode( text, &data );
+        bytes += data.size();
+    }
+};
+
+// handler which skips the content of every element below the root
+class skipping_handler : public counting_handler {
+public:
+    inline bool begin_tag( xml_span name ){ events++; return name.len > 0 && events > 1; }
+};
+
+// =========================================================================
+// entry point
+int main( int argc, char **argv ){
+    size_t megabytes = argc > 1 ? atoi( argv[1] ) : 64;
+    int    repeats   = argc > 2 ? atoi( argv[2] ) : 5;
+
+    size_t events = 0;
+    xml_span_callbacks callbacks = { &events, count_tag, count_tag, count_text, count_text, count_attribute, NULL, 0, NULL, count_text };
+
+    std::string buffer;
+    build_document( megabytes, buffer );
+    run_benchmark( "records", buffer, repeats, &callbacks );
+    run_batch_benchmark( "batched", buffer, repeats );
+    run_skip_benchmark( "skipped", buffer, repeats );
+    run_symbol_benchmark( "names", buffer, repeats );
+    run_number_benchmark( "numbers", buffer, repeats );
+
+    build_array_document( megabytes, buffer );
+    run_array_benchmark( "arrays", buffer, repeats );
+
+    build_text_document( megabytes, buffer );
+    run_benchmark( "text", buffer, repeats, &callbacks );
+
+    build_comment_document( megabytes, buffer );
+    run_benchmark( "comments", buffer, repeats, &callbacks );
+
+    build_cdata_document( megabytes, buffer );
+    run_benchmark( "cdata", buffer, repeats, &callbacks );
+
+    build_base64_document( megabytes, buffer );
+    run_base64_benchmark( "base64", buffer, repeats );
+
+    return 0;
+}
+
+// =========================================================================
+// callback implementations
+void count_tag( void *user_data, xml_span name ){
+    (*(size_t*)user_data) += name.len > 0;
+}
+
+void count_text( void *user_data, xml_span text ){
+    (*(size_t*)user_data) += text.len > 0;
+}
+
+void count_attribute( void *user_data, xml_span name, xml_span value ){
+    (*(size_t*)user_data) += name.len > 0 && value.len > 0;
+}
+
+void count_attributes( void *user_data, xml_span name, const xml_attribute *attributes, size_t count ){
+    (void)name;
+    for( size_t i=0; i<count; i++ )
+        count_attribute( user_data, attributes[i].name, attributes[i].value );
+}
+
+// =========================================================================
+// auxilliary routines
+void build_document( size_t megabytes, std::string &buffer ){
+    char record[256];
+    buffer = "<?xml version=\"1.0\"?>\n<root>\n";
+    srand( 0 );
+    while( buffer.size() < megabytes*1024*1024 ){
+        buffer += "\t<correspondence layout=\"1\" scale=\"0.468750\" rows=\"11\" columns=\"7\">";
+        buffer += "197,335,394,457,603,670,733,788,855,914,977,1139,1206,1269,1340,1407,1466\n";
+        buffer += "\t\t<!-- generated block -->\n";
+        buffer += "\t\t<corr width=\"1440\" height=\"1080\">\n";
+        for( int i=0; i<64; i++ ){
+            snprintf( record, sizeof(record), "\t\t\t<c u=\"%f\" v=\"%f\" x=\"%f\" y=\"%f\" z=\"0\" />\n",
+                      rand()/(double)RAND_MAX*1440.0, rand()/(double)RAND_MAX*1080.0,
+                      (i%7)*0.46875, (i/7)*0.46875 );
+            buffer += record;
+        }
+        buffer += "\t\t</corr>\n\t</correspondence>\n";
+    }
+    buffer += "</root>\n";
+}
+
+void build_text_document( size_t megabytes, std::string &buffer ){
+    static const char *words[] = { "lorem", "ipsum", "dolor", "sit", "amet,", "consectetur", "adipiscing", "elit." };
+    buffer = "<?xml version=\"1.0\"?>\n<root>\n";
+    srand( 0 );
+    while( buffer.size() < megabytes*1024*1024 ){
+        buffer += "\t<paragraph>";
+        for( int i=0; i<600; i++ ){
+            buffer += words[rand()%8];
+            buffer += i%16 == 15 ? "\n" : " ";
+        }
+        buffer += "</paragraph>\n";
+    }
+    buffer += "</root>\n";
+}
+
+void build_cdata_document( size_t megabytes, std::string &buffer ){
+    static const char *words[] = { "<m>", "</m>", "if( a < b )", "x > 0;", "[0]", "1.5", "]]", "&&" };
+    buffer = "<?xml version=\"1.0\"?>\n<root>\n";
+    srand( 0 );
+    while( buffer.size() < megabytes*1024*1024 ){
+        buffer += "\t<payload><![CDATA[";
+        for( int i=0; i<600; i++ ){
+            buffer += words[rand()%8];
+            buffer += i%16 == 15 ? "\n" : " ";
+        }
+        buffer += "]]></payload>\n";
+    }
+    buffer += "</root>\n";
+}
+
+void build_array_document( size_t megabytes, std::string &buffer ){
+    char value[16];
+    buffer = "<?xml version=\"1.0\"?>\n<root>\n";
+    srand( 0 );
+    while( buffer.size() < megabytes*1024*1024 ){
+        buffer += "\t<correspondence layout=\"1\" scale=\"0.468750\" rows=\"64\" columns=\"64\">";
+        for( int i=0; i<4096; i++ ){
+            snprintf( value, sizeof(value), i ? ",%d" : "%d", rand()%2048 );
+            buffer += value;
+        }
+        buffer += "</correspondence>\n";
+    }
+    buffer += "</root>\n";
+}
+
+void build_base64_document( size_t megabytes, std::string &buffer ){
+    std::vector<float> values( 4096 );
+    buffer = "<?xml version=\"1.0\"?>\n<root>\n";
+    srand( 0 );
+    for( int i=0; buffer.size() < megabytes*1024*1024; i++ ){
+        for( size_t j=0; j<values.size(); j++ )
+            values[j] = rand()/(float)RAND_MAX;
+        buffer += i%2 ? "\t<buffer type=\"float32\" count=\"4096\"><![CDATA[" : "\t<buffer type=\"float32\" count=\"4096\">";
+        xml_base64_encode( &values[0], values.size()*sizeof(float), &buffer );
+        buffer += i%2 ? "]]></buffer>\n" : "</buffer>\n";
+    }
+    buffer += "</root>\n";
+}
+
+void build_comment_document( size_t megabytes, std::string &buffer ){
+    std::string records;
+    build_document( 1, records );
+    records = records.substr( records.find( "<correspondence" ), 8192 );
+    records = records.substr( 0, records.rfind( "</correspondence>" ) + 17 );
+
+    buffer = "<?xml version=\"1.0\"?>\n<root>\n";
+    while( buffer.size() < megabytes*1024*1024 ){
+        buffer += "\t<!--\n";
+        for( int i=0; i<4; i++ ){
+            std::string disabled = records;
+            for( size_t pos=disabled.find( "--" ); pos != std::string::npos; pos=disabled.find( "--" ) )
+                disabled[pos] = '_';
+            buffer += disabled;
+        }
+        buffer += "\n\t-->\n\t";
+        buffer += records;
+        buffer += "\n";
+    }
+    buffer += "</root>\n";
+}
+
+void run_benchmark( const char *label, const std::string &buffer, int repeats, xml_span_callbacks *callbacks ){
+    double best = 1e30, best_handler = 1e30, best_pull = 1e30;
+    size_t handler_events = 0;
+    for( int i=0; i<repeats; i++ ){
+        *(size_t*)callbacks->user_data = 0;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        xml_read_document( buffer.c_str(), buffer.size(), callbacks );
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best )
+            best = elapsed.count();
+
+        counting_handler handler;
+        start = std::chrono::high_resolution_clock::now();
+        xml_parse( buffer.c_str(), buffer.size(), handler );
+        elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_handler )
+            best_handler = elapsed.count();
+        handler_events = handler.events;
+
+        size_t pull_events = 0;
+        start = std::chrono::high_resolution_clock::now();
+        xml_pull_parser parser( buffer.c_str(), buffer.size() );
+        xml_event event;
+        while( parser.next( &event ) )
+            pull_events += event.name.len > 0 || event.value.len > 0;
+        elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_pull )
+            best_pull = elapsed.count();
+    }
+    double megabytes = buffer.size()/(1024.0*1024.0);
+    printf( "%-10s callbacks %8.1f MB/s  handler %8.1f MB/s  pull %8.1f MB/s  (%lu events, %.1f MB)\n", label, megabytes/best,
+            megabytes/best_handler, megabytes/best_pull, (unsigned long)handler_events, megabytes );
+}
+
+void run_skip_benchmark( const char *label, const std::string &buffer, int repeats ){
+    double best = 1e30;
+    size_t events = 0;
+    for( int i=0; i<repeats; i++ ){
+        skipping_handler handler;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        xml_parse( buffer.c_str(), buffer.size(), handler );
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best )
+            best = elapsed.count();
+        events = handler.events;
+    }
+    double megabytes = buffer.size()/(1024.0*1024.0);
+    printf( "%-10s handler %8.1f MB/s  (%lu events, %.1f MB)\n", label, megabytes/best, (unsigned long)events, megabytes );
+}
+
+void run_symbol_benchmark( const char *label, const std::string &buffer, int repeats ){
+    xml_symbols symbols;
+    xml_init_symbols( &symbols, record_names, NAME_COUNT );
+    double best_compare = 1e30, best_symbols = 1e30;
+    size_t unknown = 0;
+    for( int i=0; i<repeats; i++ ){
+        comparing_handler comparing;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        xml_parse( buffer.c_str(), buffer.size(), comparing );
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_compare )
+            best_compare = elapsed.count();
+
+        symbol_handler handler;
+        start = std::chrono::high_resolution_clock::now();
+        xml_parse_symbols( buffer.c_str(), buffer.size(), &symbols, handler );
+        elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_symbols )
+            best_symbols = elapsed.count();
+        unknown = handler.counts[NAME_COUNT];
+    }
+    double megabytes = buffer.size()/(1024.0*1024.0);
+    printf( "%-10s compare %8.1f MB/s  symbols %8.1f MB/s  (%lu unknown names, %.1f MB)\n", label, megabytes/best_compare,
+            megabytes/best_symbols, (unsigned long)unknown, megabytes );
+}
+
+void run_batch_benchmark( const char *label, const std::string &buffer, int repeats ){
+    size_t events = 0;
+    xml_span_callbacks callbacks = { &events, count_tag, count_tag, count_text, count_text, NULL, NULL, 0, count_attributes, NULL };
+    double best = 1e30, best_handler = 1e30;
+    for( int i=0; i<repeats; i++ ){
+        events = 0;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        xml_read_document( buffer.c_str(), buffer.size(), &callbacks );
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best )
+            best = elapsed.count();
+
+        batch_handler handler;
+        start = std::chrono::high_resolution_clock::now();
+        xml_parse( buffer.c_str(), buffer.size(), handler );
+        elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_handler )
+            best_handler = elapsed.count();
+    }
+    double megabytes = buffer.size()/(1024.0*1024.0);
+    printf( "%-10s callbacks %8.1f MB/s  handler %8.1f MB/s  (%lu events, %.1f MB)\n", label, megabytes/best,
+            megabytes/best_handler, (unsigned long)events, megabytes );
+}
+
+void run_number_benchmark( const char *label, const std::string &buffer, int repeats ){
+    double best_atof = 1e30, best_span = 1e30, sum_atof = 0.0, sum_span = 0.0;
+    for( int i=0; i<repeats; i++ ){
+        atof_handler converting;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        xml_parse( buffer.c_str(), buffer.size(), converting );
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_atof )
+            best_atof = elapsed.count();
+        sum_atof = converting.sum;
+
+        number_handler handler;
+        start = std::chrono::high_resolution_clock::now();
+        xml_parse( buffer.c_str(), buffer.size(), handler );
+        elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_span )
+            best_span = elapsed.count();
+        sum_span = handler.sum;
+    }
+    double megabytes = buffer.size()/(1024.0*1024.0);
+    printf( "%-10s atof %8.1f MB/s  span %8.1f MB/s  (sums %s, %.1f MB)\n", label, megabytes/best_atof,
+            megabytes/best_span, sum_atof == sum_span ? "match" : "differ", megabytes );
+}
+
+void run_array_benchmark( const char *label, const std::string &buffer, int repeats ){
+    double best_strtol = 1e30, best_span = 1e30;
+    int64_t sum_strtol = 0, sum_span = 0;
+    for( int i=0; i<repeats; i++ ){
+        strtol_handler converting;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        xml_parse( buffer.c_str(), buffer.size(), converting );
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_strtol )
+            best_strtol = elapsed.count();
+        sum_strtol = converting.sum;
+
+        array_handler handler;
+        start = std::chrono::high_resolution_clock::now();
+        xml_parse( buffer.c_str(), buffer.size(), handler );
+        elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_span )
+            best_span = elapsed.count();
+        sum_span = handler.sum;
+    }
+    double megabytes = buffer.size()/(1024.0*1024.0);
+    printf( "%-10s strtol %8.1f MB/s  span %8.1f MB/s  (sums %s, %.1f MB)\n", label, megabytes/best_strtol,
+            megabytes/best_span, sum_strtol == sum_span ? "match" : "differ", megabytes );
+}
+
+void run_base64_benchmark( const char *label, const std::string &buffer, int repeats ){
+    double best_parse = 1e30, best_decode = 1e30;
+    size_t bytes = 0;
+    for( int i=0; i<repeats; i++ ){
+        counting_handler counting;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        xml_parse( buffer.c_str(), buffer.size(), counting );
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_parse )
+            best_parse = elapsed.count();
+
+        base64_handler handler;
+        start = std::chrono::high_resolution_clock::now();
+        xml_parse( buffer.c_str(), buffer.size(), handler );
+        elapsed = std::chrono::high_resolution_clock::now() - start;
+        if( elapsed.count() < best_decode )
+            best_decode = elapsed.count();
+        bytes = handler.bytes;
+    }
+    double megabytes = buffer.size()/(1024.0*1024.0);
+    printf( "%-10s parse %8.1f MB/s  decode %8.1f MB/s  (%.1f MB decoded, %.1f MB)\n", label, megabytes/best_parse,
+            megabytes/best_decode, bytes/(1024.0*1024.0), megabytes );
+}
@@ -1,4 +1,5 @@
 #include<cstdio>
+#include<cstring>
 #include<string>
 #include<iostream>
 #include"../../include/xml_dom.h"
@@ -6,17 +7,18 @@
 // usage instructions (Unix/OS-X)
 // compile with 'g++ main.cpp -o test', run with './test'
 
-// forward declaration of a file-reading function
-bool load_file_into_string( const char *filename, std::string &buffer );
-
 int main( int argc, char **argv ){
-    // load the example file into a buffer for reading
-    std::string buffer;
-    load_file_into_string( "../test.xml", buffer );
-    
-    // parse the data from the buffer, then locate the correspondence entity 
+    // parse the example file, then locate the correspondence entity 
     // within the DOM.
-    xml_dom_entity *doc = xml_dom_parse( buffer );
+    xml_error_info error;
+    xml_dom_entity *doc = xml_dom_parse_file( "../test.xml", XML_FILE_DEFAULT, &error );
+    if( !doc ){
+        fprintf( stderr, "Error reading ../test.xml: %s", xml_error_string( error.code ) );
+        if( error.system_error )
+            fprintf( stderr, " (%s)", strerror( error.system_error ) );
+        fprintf( stderr, "\n" );
+        return 1;
+    }
     xml_dom_entity *corr = doc->first_child_tag("root")->first_child_tag("correspondence");
     
     // Dump the xml data rooted at the corr tag to cout
@@ -38,20 +40,3 @@ int main( int argc, char **argv ){
     
     return 0;
 }
-
-bool load_file_into_string( const char *filename, std::string &buffer ){
-    long size;
-    FILE *fp = fopen( filename, "r" );
-    if(!fp){
-        printf("Error opening file %s\n", filename );
-        return false;
-    }    
-    fseek( fp, 0, SEEK_END );
-    size = ftell(fp);
-    rewind(fp);
-    
-    buffer.resize( size );
-    fread( &buffer[0], 1, size, fp );
-    fclose(fp);
-    return true;
-}
\ No newline at end of file
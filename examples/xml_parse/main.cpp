@@ -1,7 +1,9 @@
 #include<cstdio>
+#include<cstring>
 #include<iostream>
 
 #include"../../include/xml_parse.h"
+#include"../../include/xml_file.h"
 
 // usage instructions (Unix/OS-X)
 // compile with 'g++ main.cpp -o test', run with './test'
@@ -12,9 +14,6 @@
 // only used to format output
 void print_scope( int scope );
 
-// helper function to load a file into a string
-bool load_file_into_string( const char *filename, std::string &buffer );
-
 
 // =========================================================================
 // callbacks needed for parsing, see below for implementation
@@ -37,20 +36,26 @@ void attribute( void *user_data, std::string &name, std::string &value );
 // =========================================================================
 // entry point
 int main( int argc, char **argv ){
-    // load the input file into a string
-    std::string buffer;
-    load_file_into_string( "../test.xml", buffer );
+    // open the input file, it is parsed in place without being copied
+    xml_file file;
+    xml_error_info error;
+    if( !xml_open_file( &file, "../test.xml", XML_FILE_DEFAULT, &error ) ){
+        fprintf( stderr, "Error opening ../test.xml: %s\n", strerror( error.system_error ) );
+        return 1;
+    }
 
     // setup the callbacks and user data that will be used
     // during parsing, then define the xml parser state
     int scope = 0;
-    xml_callbacks callbacks = { &scope, begin_tag, end_tag, tag_text, comment, attribute };
-    xml_state state = { buffer, 0, 0, 0, &callbacks };
+    xml_callbacks callbacks = { &scope, begin_tag, end_tag, tag_text, comment, attribute, 0, NULL };
+    xml_state state;
+    xml_init_state( &state, file.data, file.size, &callbacks );
     
     // read in the document, callbacks defined below should now print
     // formatted output to stdout
     xml_read_document( &state );
     
+    xml_close_file( &file );
     return 0;
 }
 
@@ -95,21 +100,3 @@ void print_scope( int scope ){
         printf("  ");
     }
 }
-
-bool load_file_into_string( const char *filename, std::string &buffer ){
-    FILE *fp = fopen( filename, "r" );
-    if(!fp){
-        printf("Error opening file %s\n", filename );
-        return false;
-    }
-    long size;
-    
-    fseek( fp, 0, SEEK_END );
-    size = ftell(fp);
-    rewind(fp);
-    
-    buffer.resize( size );
-    fread( &buffer[0], 1, size, fp );
-    fclose(fp);
-    return true;
-}
@@ -0,0 +1,370 @@
+#ifndef XML_BASE64_H
+#define XML_BASE64_H
+
+/**
+ @file xml_base64.h
+ Base64 decoding of binary payloads embedded in text or CDATA
+ sections, e.g. float buffers, and the matching encoder for writing
+ them. Text is decoded straight from spans into a caller's buffer.
+
+ Where the compiler targets SSSE3 (or AVX2), 16 (or 32) characters
+ are translated and validated at a time with byte shuffles and packed
+ into 12 (or 24) bytes with multiply-add instructions, and encoding
+ works the same way in reverse. Blocks containing anything other than
+ base64 characters, such as line breaks, fall back to a table-driven
+ loop which skips whitespace, and the vector loop resumes at the next
+ four character boundary. Without SSSE3, or with XML_NO_SIMD defined,
+ only the table-driven loops are used.
+
+ @author James Gregson
+ */
+
+#include<cstring>
+#include<string>
+#include<vector>
+#include<stdint.h>
+
+#include"xml_parse.h"
+
+/**
+    @brief Special entries of xml_base64_decode_table
+*/
+enum {
+    /** xml whitespace, which is skipped */
+    XML_BASE64_SPACE   = 64,
+    /** the '=' padding character */
+    XML_BASE64_PAD     = 65,
+    /** any other character that is not part of the alphabet */
+    XML_BASE64_INVALID = 255
+};
+
+/** value of each base64 character, or one of the XML_BASE64_* entries */
+static const unsigned char xml_base64_decode_table[256] = {
+    255,255,255,255,255,255,255,255,255, 64, 64,255,255, 64,255,255, // 0x00-0x0F
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255, // 0x10-0x1F
+     64,255,255,255,255,255,255,255,255,255,255, 62,255,255,255, 63, // 0x20-0x2F
+     52, 53, 54, 55, 56, 57, 58, 59, 60, 61,255,255,255, 65,255,255, // 0x30-0x3F
+    255,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, // 0x40-0x4F
+     15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,255,255,255,255,255, // 0x50-0x5F
+    255, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, // 0x60-0x6F
+     41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,255,255,255,255,255, // 0x70-0x7F
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255, // 0x80-0x8F
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255, // 0x90-0x9F
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255, // 0xA0-0xAF
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255, // 0xB0-0xBF
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255, // 0xC0-0xCF
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255, // 0xD0-0xDF
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255, // 0xE0-0xEF
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255, // 0xF0-0xFF
+};
+
+/** base64 characters in order of their values */
+static const char xml_base64_alphabet[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+    Returns the maximum number of bytes decoded from 'length' characters
+    of base64 text
+
+    @param[in]  length  Number of characters of text
+    @return number of bytes the decoded data may take up
+*/
+static inline size_t xml_base64_decoded_size( size_t length ){
+    return (length+3)/4*3;
+}
+
+/**
+    Returns the number of characters produced by encoding 'size' bytes
+
+    @param[in]  size    Number of bytes to encode
+    @return number of characters of base64 text, including padding
+*/
+static inline size_t xml_base64_encoded_size( size_t size ){
+    return (size+2)/3*4;
+}
+
+#if defined(XML_SIMD_SSSE3)
+/**
+    Decodes 16 characters of base64 text to 12 bytes. The characters
+    are translated by looking up their high and low nibbles, which
+    also flags any character outside the alphabet, then 4 x 6 bit
+    values are packed into each 3 bytes with two multiply-adds.
+
+    @param[in]  in  16 characters of text
+    @param[out] out Receives 12 bytes, 16 bytes are written
+    @return false, with nothing consumed, if a character is not part
+            of the alphabet
+*/
+static inline bool xml_base64_decode_block16( const char *in, unsigned char *out ){
+    const __m128i input      = _mm_loadu_si128( (const __m128i*)in );
+    const __m128i lut_lo     = _mm_setr_epi8( 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A );
+    const __m128i lut_hi     = _mm_setr_epi8( 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 );
+    const __m128i lut_roll   = _mm_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+    const __m128i mask_2f    = _mm_set1_epi8( 0x2F );
+    const __m128i hi_nibbles = _mm_and_si128( _mm_srli_epi32( input, 4 ), mask_2f );
+    const __m128i lo_nibbles = _mm_and_si128( input, mask_2f );
+    const __m128i hi = _mm_shuffle_epi8( lut_hi, hi_nibbles );
+    const __m128i lo = _mm_shuffle_epi8( lut_lo, lo_nibbles );
+    if( _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_and_si128( lo, hi ), _mm_setzero_si128() ) ) != 0xFFFF )
+        return false;
+    
+    // '/' shares its high nibble with '+' but needs a different offset
+    const __m128i roll = _mm_shuffle_epi8( lut_roll, _mm_add_epi8( _mm_cmpeq_epi8( input, mask_2f ), hi_nibbles ) );
+    __m128i values = _mm_add_epi8( input, roll );
+    values = _mm_maddubs_epi16( values, _mm_set1_epi32( 0x01400140 ) );
+    values = _mm_madd_epi16( values, _mm_set1_epi32( 0x00011000 ) );
+    values = _mm_shuffle_epi8( values, _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 ) );
+    _mm_storeu_si128( (__m128i*)out, values );
+    return true;
+}
+
+/**
+    Encodes 12 bytes as 16 characters of base64 text. Each 3 bytes are
+    spread over a 32 bit lane and split into 6 bit values with two
+    multiplies, which are translated to characters with a shuffle.
+
+    @param[in]  in  12 bytes to encode, 16 bytes must be readable
+    @param[out] out Receives 16 characters
+*/
+static inline void xml_base64_encode_block12( const unsigned char *in, char *out ){
+    __m128i input = _mm_loadu_si128( (const __m128i*)in );
+    input = _mm_shuffle_epi8( input, _mm_setr_epi8( 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10 ) );
+    const __m128i t0 = _mm_mulhi_epu16( _mm_and_si128( input, _mm_set1_epi32( 0x0FC0FC00 ) ), _mm_set1_epi32( 0x04000040 ) );
+    const __m128i t1 = _mm_mullo_epi16( _mm_and_si128( input, _mm_set1_epi32( 0x003F03F0 ) ), _mm_set1_epi32( 0x01000010 ) );
+    const __m128i indices = _mm_or_si128( t0, t1 );
+    
+    // map 0-25, 26-51, 52-61, 62 and 63 to offsets from the value
+    const __m128i shift_lut = _mm_setr_epi8( 'a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '+'-62, '/'-63, 'A', 0, 0 );
+    __m128i shift = _mm_subs_epu8( indices, _mm_set1_epi8( 51 ) );
+    shift = _mm_or_si128( shift, _mm_and_si128( _mm_cmpgt_epi8( _mm_set1_epi8( 26 ), indices ), _mm_set1_epi8( 13 ) ) );
+    _mm_storeu_si128( (__m128i*)out, _mm_add_epi8( _mm_shuffle_epi8( shift_lut, shift ), indices ) );
+}
+#endif
+
+#if defined(XML_SIMD_AVX2)
+/**
+    Decodes 32 characters of base64 text to 24 bytes, see
+    xml_base64_decode_block16()
+
+    @param[in]  in  32 characters of text
+    @param[out] out Receives 24 bytes, 32 bytes are written
+    @return false, with nothing consumed, if a character is not part
+            of the alphabet
+*/
+static inline bool xml_base64_decode_block32( const char *in, unsigned char *out ){
+    const __m256i input      = _mm256_loadu_si256( (const __m256i*)in );
+    const __m256i lut_lo     = _mm256_broadcastsi128_si256( _mm_setr_epi8( 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A ) );
+    const __m256i lut_hi     = _mm256_broadcastsi128_si256( _mm_setr_epi8( 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 ) );
+    const __m256i lut_roll   = _mm256_broadcastsi128_si256( _mm_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 ) );
+    const __m256i mask_2f    = _mm256_set1_epi8( 0x2F );
+    const __m256i hi_nibbles = _mm256_and_si256( _mm256_srli_epi32( input, 4 ), mask_2f );
+    const __m256i lo_nibbles = _mm256_and_si256( input, mask_2f );
+    const __m256i hi = _mm256_shuffle_epi8( lut_hi, hi_nibbles );
+    const __m256i lo = _mm256_shuffle_epi8( lut_lo, lo_nibbles );
+    if( (unsigned int)_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_and_si256( lo, hi ), _mm256_setzero_si256() ) ) != 0xFFFFFFFFu )
+        return false;
+    
+    const __m256i roll = _mm256_shuffle_epi8( lut_roll, _mm256_add_epi8( _mm256_cmpeq_epi8( input, mask_2f ), hi_nibbles ) );
+    __m256i values = _mm256_add_epi8( input, roll );
+    values = _mm256_maddubs_epi16( values, _mm256_set1_epi32( 0x01400140 ) );
+    values = _mm256_madd_epi16( values, _mm256_set1_epi32( 0x00011000 ) );
+    values = _mm256_shuffle_epi8( values, _mm256_broadcastsi128_si256( _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 ) ) );
+    
+    // each lane holds 12 bytes, move them together
+    values = _mm256_permutevar8x32_epi32( values, _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, 3, 7 ) );
+    _mm256_storeu_si256( (__m256i*)out, values );
+    return true;
+}
+
+/**
+    Encodes 24 bytes as 32 characters of base64 text, see
+    xml_base64_encode_block12()
+
+    @param[in]  in  24 bytes to encode, 28 bytes must be readable
+    @param[out] out Receives 32 characters
+*/
+static inline void xml_base64_encode_block24( const unsigned char *in, char *out ){
+    __m256i input = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i*)in ) ),
+                                             _mm_loadu_si128( (const __m128i*)(in+12) ), 1 );
+    input = _mm256_shuffle_epi8( input, _mm256_broadcastsi128_si256( _mm_setr_epi8( 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10 ) ) );
+    const __m256i t0 = _mm256_mulhi_epu16( _mm256_and_si256( input, _mm256_set1_epi32( 0x0FC0FC00 ) ), _mm256_set1_epi32( 0x04000040 ) );
+    const __m256i t1 = _mm256_mullo_epi16( _mm256_and_si256( input, _mm256_set1_epi32( 0x003F03F0 ) ), _mm256_set1_epi32( 0x01000010 ) );
+    const __m256i indices = _mm256_or_si256( t0, t1 );
+    
+    const __m256i shift_lut = _mm256_broadcastsi128_si256( _mm_setr_epi8( 'a'-26, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '0'-52, '+'-62, '/'-63, 'A', 0, 0 ) );
+    __m256i shift = _mm256_subs_epu8( indices, _mm256_set1_epi8( 51 ) );
+    shift = _mm256_or_si256( shift, _mm256_and_si256( _mm256_cmpgt_epi8( _mm256_set1_epi8( 26 ), indices ), _mm256_set1_epi8( 13 ) ) );
+    _mm256_storeu_si256( (__m256i*)out, _mm256_add_epi8( _mm256_shuffle_epi8( shift_lut, shift ), indices ) );
+}
+#endif
+
+/**
+    Decodes base64 text, e.g. the span passed to tag_text or cdata,
+    into a caller-supplied buffer. Whitespace anywhere in the text is
+    ignored, and the final group of characters may be padded with '='
+    or left unpadded.
+
+    @param[in]  text        Base64 text to decode
+    @param[out] data        Buffer receiving the decoded bytes
+    @param[in]  capacity    Size of 'data' in bytes. Blocks are decoded
+                            with vector stores while at least 32 bytes
+                            remain, so a buffer of
+                            xml_base64_decoded_size()+32 bytes is
+                            decoded entirely with them.
+    @param[out] size        Number of bytes decoded, may be NULL
+    @return true if the text was decoded completely, false if it is not
+            valid base64 or the decoded data does not fit in 'data'
+*/
+static inline bool xml_base64_decode( xml_span text, void *data, size_t capacity, size_t *size ){
+    const char *p = text.str, *end = text.str+text.len;
+    unsigned char *out = (unsigned char*)data, *out_end = out+capacity;
+    uint32_t bits = 0;
+    int count = 0;
+    bool ok = true;
+    for(;;){
+        // vector blocks are only decoded between groups of four
+        if( count == 0 ){
+#if defined(XML_SIMD_AVX2)
+            while( end-p >= 32 && out_end-out >= 32 && xml_base64_decode_block32( p, out ) ){
+                p   += 32;
+                out += 24;
+            }
+#endif
+#if defined(XML_SIMD_SSSE3)
+            while( end-p >= 16 && out_end-out >= 16 && xml_base64_decode_block16( p, out ) ){
+                p   += 16;
+                out += 12;
+            }
+#endif
+        }
+        if( p >= end )
+            break;
+        
+        const unsigned char value = xml_base64_decode_table[(unsigned char)*p++];
+        if( value < 64 ){
+            bits = bits << 6 | value;
+            if( ++count == 4 ){
+                if( out_end-out < 3 ){
+                    ok = false;
+                    break;
+                }
+                out[0] = (unsigned char)(bits >> 16);
+                out[1] = (unsigned char)(bits >> 8);
+                out[2] = (unsigned char)bits;
+                out  += 3;
+                bits  = 0;
+                count = 0;
+            }
+        } else if( value == XML_BASE64_PAD ){
+            // one '=' completes a group of three, two a group of two,
+            // and only whitespace may follow
+            int pads = 1;
+            for( ; p < end && ok; p++ ){
+                const unsigned char next = xml_base64_decode_table[(unsigned char)*p];
+                if( next == XML_BASE64_PAD )
+                    pads++;
+                else if( next != XML_BASE64_SPACE )
+                    ok = false;
+            }
+            ok = ok && count >= 2 && pads == 4-count;
+            break;
+        } else if( value != XML_BASE64_SPACE ){
+            ok = false;
+            break;
+        }
+    }
+    
+    // a final partial group of two or three characters holds one or two bytes
+    if( ok && count ){
+        ok = count >= 2 && out_end-out >= count-1;
+        if( ok ){
+            bits <<= 6*(4-count);
+            out[0] = (unsigned char)(bits >> 16);
+            if( count == 3 )
+                out[1] = (unsigned char)(bits >> 8);
+            out += count-1;
+        }
+    }
+    if( size )
+        *size = out-(unsigned char*)data;
+    return ok;
+}
+
+/**
+    Decodes base64 text and appends the bytes to 'data', see
+    xml_base64_decode()
+
+    @param[in]  text    Base64 text to decode
+    @param[out] data    Vector the decoded bytes are appended to
+    @return true if the text was decoded completely, otherwise the
+            bytes decoded before the error are appended
+*/
+static inline bool xml_base64_decode( xml_span text, std::vector<unsigned char> *data ){
+    const size_t offset = data->size();
+    data->resize( offset + xml_base64_decoded_size( text.len ) + 32 );
+    size_t size = 0;
+    bool ok = xml_base64_decode( text, &(*data)[offset], data->size()-offset, &size );
+    data->resize( offset + size );
+    return ok;
+}
+
+/**
+    Encodes 'size' bytes as base64 text, with padding and without line
+    breaks
+
+    @param[in]  data    Bytes to encode
+    @param[in]  size    Number of bytes
+    @param[out] text    Receives xml_base64_encoded_size( size ) characters
+    @return number of characters written
+*/
+static inline size_t xml_base64_encode( const void *data, size_t size, char *text ){
+    const unsigned char *p = (const unsigned char*)data, *end = p+size;
+    char *out = text;
+#if defined(XML_SIMD_AVX2)
+    while( end-p >= 28 ){
+        xml_base64_encode_block24( p, out );
+        p   += 24;
+        out += 32;
+    }
+#endif
+#if defined(XML_SIMD_SSSE3)
+    while( end-p >= 16 ){
+        xml_base64_encode_block12( p, out );
+        p   += 12;
+        out += 16;
+    }
+#endif
+    for( ; end-p >= 3; p += 3 ){
+        const uint32_t bits = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+        out[0] = xml_base64_alphabet[bits >> 18];
+        out[1] = xml_base64_alphabet[(bits >> 12) & 0x3F];
+        out[2] = xml_base64_alphabet[(bits >> 6) & 0x3F];
+        out[3] = xml_base64_alphabet[bits & 0x3F];
+        out += 4;
+    }
+    if( end-p > 0 ){
+        const uint32_t bits = (uint32_t)p[0] << 16 | (end-p > 1 ? (uint32_t)p[1] << 8 : 0);
+        out[0] = xml_base64_alphabet[bits >> 18];
+        out[1] = xml_base64_alphabet[(bits >> 12) & 0x3F];
+        out[2] = end-p > 1 ? xml_base64_alphabet[(bits >> 6) & 0x3F] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+    return out-text;
+}
+
+/**
+    Encodes 'size' bytes as base64 text and appends it to 'text', see
+    xml_base64_encode()
+
+    @param[in]  data    Bytes to encode
+    @param[in]  size    Number of bytes
+    @param[out] text    String the text is appended to
+*/
+static inline void xml_base64_encode( const void *data, size_t size, std::string *text ){
+    const size_t offset = text->size();
+    text->resize( offset + xml_base64_encoded_size( size ) );
+    if( size )
+        xml_base64_encode( data, size, &(*text)[offset] );
+}
+
+#endif
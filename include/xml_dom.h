@@ -1,7 +1,6 @@
 #ifndef XML_DOM_H
 #define XML_DOM_H
 
-#include<list>
 #include<string>
 #include<vector>
 #include<cassert>
@@ -9,6 +8,9 @@
 #include<iostream>
 
 #include"xml_parse.h"
+#include"xml_file.h"
+#include"xml_number.h"
+#include"xml_base64.h"
 
 /**
     @file xml_dom.h
@@ -30,6 +32,7 @@ typedef enum {
     XML_DOM_TAG,
     XML_DOM_ATTRIBUTE,
     XML_DOM_COMMENT,
+    XML_DOM_CDATA,
 } xml_dom_entity_type;
 
 /**
@@ -71,6 +74,7 @@ private:
             TAG       - the text of the tag
             ATTRIBUTE - the value of the attribute
             COMMENT   - the comment text
+            CDATA     - the content of the CDATA section
     */
     std::string                     m_value;
 public:
@@ -180,6 +184,19 @@ public:
         return comm;
     }
     
+    /**
+     convenience method to add a CDATA section holding 'text' as a
+     child to the current tag
+    */
+    inline xml_dom_entity *add_cdata( std::string text ){
+        assert( m_type == XML_DOM_TAG );
+        xml_dom_entity *cdata = new xml_dom_entity();
+        cdata->set_type( XML_DOM_CDATA );
+        cdata->set_value( text );
+        add_child( cdata );
+        return cdata;
+    }
+    
     /**
      adds an existing child to the entity
     */
@@ -221,7 +238,81 @@ public:
         assert( m_type != XML_DOM_INVALID );
         m_value = value;
     }
-    
+
+    /**
+     returns the value of the entity converted to a double, or
+     'fallback' if it is not a number, see xml_span_to_double()
+     */
+    inline double as_double( double fallback=0.0 ){
+        assert( m_type != XML_DOM_INVALID );
+        double value = fallback;
+        xml_span_to_double( xml_make_span( m_value.data(), m_value.size() ), &value );
+        return value;
+    }
+
+    /**
+     returns the value of the entity converted to a float, or
+     'fallback' if it is not a number, see xml_span_to_float()
+     */
+    inline float as_float( float fallback=0.0f ){
+        assert( m_type != XML_DOM_INVALID );
+        float value = fallback;
+        xml_span_to_float( xml_make_span( m_value.data(), m_value.size() ), &value );
+        return value;
+    }
+
+    /**
+     returns the value of the entity converted to an integer, or
+     'fallback' if it is not an integer, see xml_span_to_int64()
+     */
+    inline int64_t as_int64( int64_t fallback=0 ){
+        assert( m_type != XML_DOM_INVALID );
+        int64_t value = fallback;
+        xml_span_to_int64( xml_make_span( m_value.data(), m_value.size() ), &value );
+        return value;
+    }
+
+    /**
+     appends the comma and/or whitespace separated integers in the
+     value of the entity (e.g. the text of a tag) to 'values', see
+     xml_span_to_int32_vector(). Returns false if the value is not
+     such a list.
+     */
+    inline bool as_int32_vector( std::vector<int32_t> *values ){
+        assert( m_type != XML_DOM_INVALID );
+        return xml_span_to_int32_vector( xml_make_span( m_value.data(), m_value.size() ), values );
+    }
+
+    /**
+     appends the comma and/or whitespace separated numbers in the
+     value of the entity to 'values', see xml_span_to_double_vector().
+     Returns false if the value is not such a list.
+     */
+    inline bool as_double_vector( std::vector<double> *values ){
+        assert( m_type != XML_DOM_INVALID );
+        return xml_span_to_double_vector( xml_make_span( m_value.data(), m_value.size() ), values );
+    }
+
+    /**
+     appends the binary data encoded as base64 in the value of the
+     entity (e.g. the text of a tag or a CDATA section) to 'data', see
+     xml_base64_decode(). Returns false if the value is not base64.
+     */
+    inline bool as_base64( std::vector<unsigned char> *data ){
+        assert( m_type != XML_DOM_INVALID );
+        return xml_base64_decode( xml_make_span( m_value.data(), m_value.size() ), data );
+    }
+
+    /**
+     sets the value of the entity to 'size' bytes of binary data
+     encoded as base64, see xml_base64_encode()
+     */
+    inline void set_base64( const void *data, size_t size ){
+        assert( m_type != XML_DOM_INVALID );
+        m_value.clear();
+        xml_base64_encode( data, size, &m_value );
+    }
+
     /**
      returns the first child (which may be a tag, comment or
      attribute) of this entity
@@ -270,6 +361,13 @@ public:
         return first_child( XML_DOM_COMMENT );
     }
 
+    /**
+     returns the first child entity that is a CDATA section
+     */
+    inline xml_dom_entity *first_child_cdata(){
+        return first_child( XML_DOM_CDATA );
+    }
+
     /**
      returns the first child element of this entity whose type
      matches 'type' and name matches 'name'
@@ -608,6 +706,14 @@ public:
         return next_sibling( XML_DOM_COMMENT );
     }
     
+    /**
+     returns the next sibling of the current entity that
+     is a CDATA section
+     */
+    inline xml_dom_entity *next_sibling_cdata(){
+        return next_sibling( XML_DOM_CDATA );
+    }
+    
     /** 
      debugging method for printing
     */
@@ -627,6 +733,9 @@ public:
             case XML_DOM_COMMENT:
                 printf("COMMENT: %s\n", get_value().c_str() );
                 break;
+            case XML_DOM_CDATA:
+                printf("CDATA: %s\n", get_value().c_str() );
+                break;
             case XML_DOM_ATTRIBUTE:
                 printf("ATTRIBUTE: %s=%s\n", get_name().c_str(), get_value().c_str() );
                 break;
@@ -697,88 +806,143 @@ std::ostream& operator<<( std::ostream &output, xml_dom_entity &item ){
 */
  
 /**
- DOM-builder callback for when the xml parser encounters an
- opening tag.  Creates the tag, adds it to the last tag 
- currently on the stack and then pushes the new tag onto the
- stack
+ @brief Handler which builds the DOM from parser events. It is passed
+ to the templated parser so its event handling is inlined into the
+ scanning loop. Open tags are tracked with a stack whose bottom entry
+ is the document itself.
 */
-static inline void xml_dom_begin_tag_cb( void *user_data, std::string &name ){
-    std::list<xml_dom_entity*> *stack = (std::list<xml_dom_entity*>*) user_data;    
-    xml_dom_entity *tag = new xml_dom_entity();
-    tag->set_type( XML_DOM_TAG );
-    tag->set_name( name );
-    stack->back()->add_child( tag );
-    stack->push_back( tag );
-}
-
-/**
- DOM-builder callback for when the parser encounters a
- closing tag. Just pops the tag-stack
-*/
-static inline void xml_dom_end_tag_cb( void *user_data, std::string &name ){
-    std::list<xml_dom_entity*> *stack = (std::list<xml_dom_entity*>*) user_data;
-    name=name;
-    stack->pop_back();
-}
-
-/**
- DOM-builder callback for when the parser encounters the
- text for a tag, simply sets the text of the top tag on
- the tag-stack
-*/
-static void xml_dom_tag_text_cb( void *user_data, std::string &text ){
-    std::list<xml_dom_entity*> *stack = (std::list<xml_dom_entity*>*) user_data;
-    stack->back()->set_value( text );
-}
+class xml_dom_builder : public xml_handler {
+private:
+    /** stack of open entities, the innermost tag is last */
+    std::vector<xml_dom_entity*>    m_stack;
+public:
+    /**
+     Starts building into the document entity 'doc'
+    */
+    xml_dom_builder( xml_dom_entity *doc ){
+        m_stack.push_back( doc );
+    }
+    
+    /**
+     Creates the tag, adds it to the last tag currently on the
+     stack and then pushes the new tag onto the stack
+    */
+    inline void begin_tag( xml_span name ){
+        xml_dom_entity *tag = new xml_dom_entity();
+        tag->set_type( XML_DOM_TAG );
+        tag->set_name( xml_span_to_string( name ) );
+        m_stack.back()->add_child( tag );
+        m_stack.push_back( tag );
+    }
+    
+    /**
+     Just pops the tag-stack
+    */
+    inline void end_tag( xml_span name ){
+        (void)name;
+        m_stack.pop_back();
+    }
+    
+    /**
+     Simply sets the text of the top tag on the tag-stack
+    */
+    inline void tag_text( xml_span text ){
+        m_stack.back()->set_value( xml_span_to_string( text ) );
+    }
+    
+    /**
+     Adds the comment to the top tag on the tag-stack
+    */
+    inline void comment( xml_span comment ){
+        xml_dom_entity *text = new xml_dom_entity();
+        text->set_type( XML_DOM_COMMENT );
+        text->set_value( xml_span_to_string( comment ) );
+        m_stack.back()->add_child( text );
+    }
+    
+    /**
+     Adds the CDATA section to the top tag on the tag-stack
+    */
+    inline void cdata( xml_span text ){
+        xml_dom_entity *section = new xml_dom_entity();
+        section->set_type( XML_DOM_CDATA );
+        section->set_value( xml_span_to_string( text ) );
+        m_stack.back()->add_child( section );
+    }
+    
+    /**
+     Adds the attribute to the top tag on the tag stack
+    */
+    inline void attribute( xml_span name, xml_span value ){
+        xml_dom_entity *attrib = new xml_dom_entity();
+        attrib->set_type( XML_DOM_ATTRIBUTE );
+        attrib->set_name( xml_span_to_string( name ) );
+        attrib->set_value( xml_span_to_string( value ) );
+        m_stack.back()->add_child( attrib );
+    }
+};
 
 /**
- DOM-builder callback for when a comment is encountered
- by the parser.  Just adds the comment to the top tag on
- the tag-stack
+ Parses the 'size' characters of xml data at 'buffer' and
+ returns a pointer to the root entity (an xml_dom_entity with
+ type XML_DOM_DOCUMENT). The buffer is read in place and is
+ not copied, buffer[size] must be '\0'. If the document is
+ malformed NULL is returned and the error is stored in 'error',
+ or reported (see xml_raise_error()) if 'error' is NULL.
 */
-static void xml_dom_comment_cb( void *user_data, std::string &comment ){
-    std::list<xml_dom_entity*> *stack = (std::list<xml_dom_entity*>*) user_data;
-    xml_dom_entity *text = new xml_dom_entity();
-    text->set_type( XML_DOM_COMMENT );
-    text->set_value( comment );
-    stack->back()->add_child( text );
+static inline xml_dom_entity *xml_dom_parse( const char *buffer, size_t size, xml_error_info *error=NULL ){
+    // create the root element and the builder which adds to it
+    xml_dom_entity *doc = new xml_dom_entity();
+    doc->set_type( XML_DOM_DOCUMENT );
+    xml_dom_builder builder( doc );
+    
+    // parse the document, discarding the partial DOM on error
+    xml_error_info info;
+    if( !xml_parse( buffer, size, builder, &info ) ){
+        delete doc;
+        if( error )
+            *error = info;
+        else
+            xml_raise_error( &info );
+        return NULL;
+    }
+    if( error )
+        *error = info;
+    
+    return doc;
 }
 
 /**
- DOM-builder callback for when an attribute is encountered
- by the parser. Adds the attribute to the top tag on the
- tag stack
+ Parses the document in buffer and returns a pointer to the
+ root entity (an xml_dom_entity with type XML_DOM_DOCUMENT),
+ see xml_dom_parse() above
 */
-static void xml_dom_attribute_cb( void *user_data, std::string &name, std::string &value ){
-    std::list<xml_dom_entity*> *stack = (std::list<xml_dom_entity*>*) user_data;
-    xml_dom_entity *attrib = new xml_dom_entity();
-    attrib->set_type( XML_DOM_ATTRIBUTE );
-    attrib->set_name( name );
-    attrib->set_value( value );
-    stack->back()->add_child( attrib );
+static inline xml_dom_entity *xml_dom_parse( std::string &buffer, xml_error_info *error=NULL ){
+    return xml_dom_parse( buffer.c_str(), buffer.size(), error );
 }
 
 /**
- Parses the document in buffer and returns a pointer to the
- root entity (an xml_dom_entity with type XML_DOM_DOCUMENT)
+ Parses the file 'filename' and returns a pointer to the root
+ entity (an xml_dom_entity with type XML_DOM_DOCUMENT), or NULL if
+ the file could not be read or is malformed, see xml_dom_parse().
+ A file which cannot be opened or read is reported like a malformed
+ one, with code XML_ERROR_OPEN or XML_ERROR_READ and the errno in
+ 'system_error'. The file is parsed directly from a read-only memory
+ mapping where possible, see xml_open_file().
 */
-static xml_dom_entity *xml_dom_parse( std::string &buffer ){
-    std::list<xml_dom_entity*> stack;
-    
-    // create the callback structure and the xml parser state
-    xml_callbacks callbacks = { &stack, xml_dom_begin_tag_cb, xml_dom_end_tag_cb, xml_dom_tag_text_cb, xml_dom_comment_cb, xml_dom_attribute_cb };
-    xml_state state = { buffer, 0, 0, 0, &callbacks };
-    
-    // create the root element and push it onto the stack
-    xml_dom_entity *doc = new xml_dom_entity();
-    doc->set_type( XML_DOM_DOCUMENT );
-    stack.push_back( doc );
-    
-    // parse the document
-    xml_read_document( &state );
-    
-    // return the front of the stack
-    return stack.front();
+static inline xml_dom_entity *xml_dom_parse_file( const char *filename, unsigned hints=XML_FILE_DEFAULT, xml_error_info *error=NULL ){
+    xml_file file;
+    xml_error_info info;
+    xml_dom_entity *doc = NULL;
+    if( xml_open_file( &file, filename, hints, &info ) ){
+        doc = xml_dom_parse( file.data, file.size, &info );
+        xml_close_file( &file );
+    }
+    if( error )
+        *error = info;
+    else if( !doc )
+        xml_raise_error( &info );
+    return doc;
 }
 
 #endif
@@ -0,0 +1,321 @@
+#ifndef XML_FILE_H
+#define XML_FILE_H
+
+/**
+ @file xml_file.h
+ Read-only file input for the parser. On POSIX systems the file is
+ memory-mapped and parsed in place, so that no copy of the document is
+ made and a file already in the page cache is available immediately;
+ the kernel is told the mapping will be read sequentially so that it
+ reads ahead. The mapping is always followed by at least one zero
+ byte, which provides the '\0' sentinel the parser requires even when
+ the file size is a multiple of the page size.
+
+ Elsewhere, for inputs that cannot be mapped (e.g. pipes), or when
+ XML_NO_MMAP is defined, the file is read into a heap buffer instead.
+ 
+ Inputs too large to hold in memory can instead be streamed through
+ an xml_push_parser with xml_parse_stream() or xml_parse_fd(), which
+ use a fixed-size buffer whatever the size of the input.
+
+ @author James Gregson
+ */
+
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<cerrno>
+
+#include"xml_parse.h"
+
+#if !defined(XML_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define XML_FILE_MMAP
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+/** number of characters read from a stream at a time */
+#ifndef XML_STREAM_CHUNK_SIZE
+#define XML_STREAM_CHUNK_SIZE (1<<20)
+#endif
+
+/** default limit on the size of a single token when streaming, which
+    together with the chunk size bounds the memory used */
+#ifndef XML_STREAM_MAX_TOKEN
+#define XML_STREAM_MAX_TOKEN (16<<20)
+#endif
+
+/**
+    @brief Access hints for xml_open_file(), combined with |. They are
+    passed to madvise() and ignored where unsupported.
+*/
+enum {
+    /** the file will be read from start to end, read ahead aggressively */
+    XML_FILE_SEQUENTIAL = 1,
+    /** start reading the whole file into the page cache immediately */
+    XML_FILE_WILLNEED   = 2,
+    /** back the mapping with huge pages if the system allows it */
+    XML_FILE_HUGE_PAGES = 4,
+    /** hints used when none are given */
+    XML_FILE_DEFAULT    = XML_FILE_SEQUENTIAL | XML_FILE_WILLNEED
+};
+
+/**
+    @brief An open input file, see xml_open_file()
+*/
+typedef struct {
+    /** contents of the file, followed by a '\0' sentinel */
+    const char              *data;
+    
+    /** number of characters in the file */
+    size_t                  size;
+    
+    /** start of the memory mapping, or NULL if the file was read into 'buffer' */
+    void                    *mapping;
+    
+    /** size of the memory mapping */
+    size_t                  mapping_size;
+    
+    /** heap copy of the file when it was not mapped */
+    char                    *buffer;
+} xml_file;
+
+/**
+    Records a failure to open or read a file in 'error', if given. The
+    error has no position within the document.
+    
+    @param[out] error        Receives the error, may be NULL
+    @param[in]  code         XML_ERROR_OPEN or XML_ERROR_READ
+    @param[in]  system_error errno of the call which failed
+    @return false, so that callers can return the result directly
+*/
+static inline bool xml_file_error( xml_error_info *error, xml_error_code code, int system_error ){
+    if( error ){
+        error->code         = code;
+        error->offset       = 0;
+        error->line         = 0;
+        error->column       = 0;
+        error->expected[0]  = '\0';
+        error->actual       = '\0';
+        error->system_error = system_error;
+    }
+    return false;
+}
+
+/**
+    Reads the whole of 'fp' into a heap buffer followed by a '\0'
+    sentinel, used when the file cannot be mapped
+    
+    @param[in]  file    File to fill in
+    @param[in]  fp      Stream to read until its end
+    @return true on success, false (with errno set) if out of memory
+            or a read failed
+*/
+static inline bool xml_read_file_stream( xml_file *file, FILE *fp ){
+    size_t capacity = 65536, size = 0, count;
+    char *buffer = (char*)malloc( capacity+1 );
+    while( buffer && (count = fread( buffer+size, 1, capacity-size, fp )) > 0 ){
+        size += count;
+        if( size == capacity ){
+            char *grown = (char*)realloc( buffer, 2*capacity+1 );
+            if( !grown )
+                free( buffer );
+            buffer = grown;
+            capacity *= 2;
+        }
+    }
+    if( !buffer || ferror( fp ) ){
+        const int failure = buffer ? errno : ENOMEM;
+        free( buffer );
+        errno = failure;
+        return false;
+    }
+    buffer[size] = '\0';
+    file->data   = buffer;
+    file->size   = size;
+    file->buffer = buffer;
+    return true;
+}
+
+/**
+    Opens 'filename' for parsing, e.g. with
+    xml_parse( file.data, file.size, handler ). Regular files are
+    memory-mapped read-only where supported, otherwise the file is
+    read into memory. The file must be released with xml_close_file().
+    Nothing is printed on failure: 'error' receives XML_ERROR_OPEN or
+    XML_ERROR_READ with the errno of the call which failed, so that a
+    missing or unreadable file can be told apart from a malformed one.
+    
+    @param[in]  file     File to fill in
+    @param[in]  filename Path of the file to open
+    @param[in]  hints    Access hints, see XML_FILE_SEQUENTIAL etc.
+    @param[out] error    Receives the reason for a failure, may be NULL
+    @return true on success, false if the file could not be opened or read
+*/
+static inline bool xml_open_file( xml_file *file, const char *filename, unsigned hints=XML_FILE_DEFAULT, xml_error_info *error=NULL ){
+    file->data         = NULL;
+    file->size         = 0;
+    file->mapping      = NULL;
+    file->mapping_size = 0;
+    file->buffer       = NULL;
+    
+#if defined(XML_FILE_MMAP)
+    int fd = open( filename, O_RDONLY );
+    if( fd < 0 )
+        return xml_file_error( error, XML_ERROR_OPEN, errno );
+    struct stat info;
+    if( fstat( fd, &info ) == 0 && S_ISREG( info.st_mode ) ){
+        // reserve the file size plus at least one byte of zeroed
+        // pages, then map the file over the start of the reservation
+        // so that the sentinel is readable whatever the file size
+        const size_t size = (size_t)info.st_size;
+        const size_t page = (size_t)sysconf( _SC_PAGESIZE );
+        const size_t mapping_size = (size/page+1)*page;
+        void *mapping = mmap( NULL, mapping_size, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+        if( mapping != MAP_FAILED && size > 0 &&
+            mmap( mapping, size, PROT_READ, MAP_PRIVATE|MAP_FIXED, fd, 0 ) == MAP_FAILED ){
+            munmap( mapping, mapping_size );
+            mapping = MAP_FAILED;
+        }
+        if( mapping != MAP_FAILED ){
+            close( fd );
+#if defined(MADV_SEQUENTIAL)
+            if( hints & XML_FILE_SEQUENTIAL )
+                madvise( mapping, mapping_size, MADV_SEQUENTIAL );
+#endif
+#if defined(MADV_WILLNEED)
+            if( hints & XML_FILE_WILLNEED )
+                madvise( mapping, mapping_size, MADV_WILLNEED );
+#endif
+#if defined(MADV_HUGEPAGE)
+            if( hints & XML_FILE_HUGE_PAGES )
+                madvise( mapping, mapping_size, MADV_HUGEPAGE );
+#endif
+            file->data         = (const char*)mapping;
+            file->size         = size;
+            file->mapping      = mapping;
+            file->mapping_size = mapping_size;
+            return true;
+        }
+    }
+    
+    // not a regular file or it could not be mapped, read it instead
+    FILE *fp = fdopen( fd, "rb" );
+    if( !fp ){
+        const int failure = errno;
+        close( fd );
+        return xml_file_error( error, XML_ERROR_OPEN, failure );
+    }
+#else
+    (void)hints;
+    FILE *fp = fopen( filename, "rb" );
+    if( !fp )
+        return xml_file_error( error, XML_ERROR_OPEN, errno );
+#endif
+    if( !xml_read_file_stream( file, fp ) ){
+        const int failure = errno;
+        fclose( fp );
+        return xml_file_error( error, XML_ERROR_READ, failure );
+    }
+    fclose( fp );
+    return true;
+}
+
+/**
+    Releases a file opened with xml_open_file(). Spans into the file
+    contents are invalid afterwards.
+    
+    @param[in]  file    File to release
+*/
+static inline void xml_close_file( xml_file *file ){
+#if defined(XML_FILE_MMAP)
+    if( file->mapping )
+        munmap( file->mapping, file->mapping_size );
+#endif
+    free( file->buffer );
+    file->data         = NULL;
+    file->size         = 0;
+    file->mapping      = NULL;
+    file->mapping_size = 0;
+    file->buffer       = NULL;
+}
+
+/**
+    Parses the document read from 'fp' until its end, calling the member
+    functions of 'handler' (see xml_handler) for each event. The input
+    is read 'chunk_size' characters at a time directly into the buffer
+    of an xml_push_parser, which keeps only the token in progress between
+    reads, so memory use is bounded by the chunk size plus 'max_token'
+    (zero for no limit) however large the input is. No more input is
+    read once the handler stops parsing.
+    
+    @param[in]  fp          Stream to read
+    @param[in]  handler     Handler receiving the parser events
+    @param[out] error       Receives the first error, or NULL to report errors
+    @param[in]  chunk_size  Number of characters to read at a time
+    @param[in]  max_token   Maximum size of a single token
+    @return true if the document was read without error
+*/
+template< typename Handler >
+inline bool xml_parse_stream( FILE *fp, Handler &handler, xml_error_info *error=NULL, size_t chunk_size=XML_STREAM_CHUNK_SIZE, size_t max_token=XML_STREAM_MAX_TOKEN ){
+    xml_push_parser<Handler> parser( handler, max_token );
+    size_t count;
+    xml_status status = XML_INCOMPLETE;
+    while( status == XML_INCOMPLETE && (count = fread( parser.input_buffer( chunk_size ), 1, chunk_size, fp )) > 0 ){
+        status = parser.commit( count );
+    }
+    if( status == XML_INCOMPLETE ){
+        if( ferror( fp ) ){
+            const int failure = errno;
+            xml_set_error( parser.state(), parser.state()->end, XML_ERROR_READ, NULL );
+            parser.state()->error.system_error = failure;
+        } else
+            parser.finish();
+    }
+    return xml_report_status( parser.state(), error );
+}
+
+#if defined(XML_FILE_MMAP)
+/**
+    Parses the document read from the file descriptor 'fd' until its
+    end, see xml_parse_stream(). Reads use read() directly, and the
+    kernel is advised that the input is read sequentially.
+    
+    @param[in]  fd          File descriptor to read
+    @param[in]  handler     Handler receiving the parser events
+    @param[out] error       Receives the first error, or NULL to report errors
+    @param[in]  chunk_size  Number of characters to read at a time
+    @param[in]  max_token   Maximum size of a single token
+    @return true if the document was read without error
+*/
+template< typename Handler >
+inline bool xml_parse_fd( int fd, Handler &handler, xml_error_info *error=NULL, size_t chunk_size=XML_STREAM_CHUNK_SIZE, size_t max_token=XML_STREAM_MAX_TOKEN ){
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+    xml_push_parser<Handler> parser( handler, max_token );
+    xml_status status = XML_INCOMPLETE;
+    while( status == XML_INCOMPLETE ){
+        ssize_t count = read( fd, parser.input_buffer( chunk_size ), chunk_size );
+        if( count > 0 ){
+            status = parser.commit( (size_t)count );
+        } else if( count == 0 ){
+            parser.finish();
+            break;
+        } else if( errno != EINTR ){
+            const int failure = errno;
+            xml_set_error( parser.state(), parser.state()->end, XML_ERROR_READ, NULL );
+            parser.state()->error.system_error = failure;
+            break;
+        }
+    }
+    return xml_report_status( parser.state(), error );
+}
+#endif
+
+#endif
@@ -0,0 +1,502 @@
+#ifndef XML_NUMBER_H
+#define XML_NUMBER_H
+
+/**
+ @file xml_number.h
+ Conversion of attribute values and text to numbers, independent of
+ the C locale. Values are read directly from spans into the document
+ without copying them into strings.
+
+ Decimal numbers are scanned once into a 64 bit mantissa and a power
+ of ten. When the mantissa and power are small enough that both are
+ exactly representable, the result is a single correctly rounded
+ multiplication or division (Clinger's fast path), which covers
+ typical values such as "500.126617" or "1440". Other values fall
+ back to std::from_chars where the standard library provides it for
+ floating point, or to strtod()/strtof() with the decimal point
+ adapted to the current locale, both of which are correctly rounded.
+
+ The accepted syntax is that of xsd:double, i.e. an optional sign,
+ digits with an optional fraction and an optional exponent, or one of
+ INF, -INF and NaN. Leading and trailing whitespace is ignored.
+
+ Lists of numbers, such as the comma-separated integers often found
+ in tag text, are read straight into a vector or a caller's buffer.
+ Values may be separated by whitespace, by a comma, or both. The
+ digits of each integer are found with a vector compare (see
+ xml_digit_run()) and up to eight of them are converted at once
+ within a 64 bit word.
+
+ @author James Gregson
+ */
+
+#include<cfloat>
+#include<cmath>
+#include<clocale>
+#include<cstdlib>
+#include<cstring>
+#include<limits>
+#include<string>
+#include<vector>
+#include<stdint.h>
+
+#if defined(__has_include)
+#if __has_include(<charconv>) && __cplusplus >= 201703L
+#include<charconv>
+#endif
+#endif
+
+#include"xml_parse.h"
+
+/** defined when std::from_chars is available for floating point */
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define XML_NUMBER_FROM_CHARS
+#endif
+
+/**
+    @brief Decimal number scanned by xml_scan_number(), with the value
+    (-1)^negative * mantissa * 10^exponent unless 'special' is set
+*/
+typedef struct {
+    /** up to 19 significant digits of the number */
+    uint64_t                mantissa;
+
+    /** power of ten by which the mantissa is scaled */
+    int                     exponent;
+
+    /** true if non-zero digits beyond the first 19 were dropped */
+    bool                    truncated;
+
+    /** true if the number is negative */
+    bool                    negative;
+
+    /** 'I' for INF, 'N' for NaN, '\0' for a decimal number */
+    char                    special;
+
+    /** first and one past the last character of the number, without
+        its sign and surrounding whitespace */
+    const char              *begin;
+    const char              *end;
+} xml_decimal;
+
+/**
+    Scans 'span' as a decimal number
+
+    @param[in]  span    Characters to scan
+    @param[out] number  The number scanned
+    @return true if the whole span (apart from surrounding whitespace)
+            is a number
+*/
+static inline bool xml_scan_number( xml_span span, xml_decimal *number ){
+    const char *p = span.str, *end = span.str+span.len;
+    while( p < end && xml_is_space( *p ) )
+        p++;
+    while( end > p && xml_is_space( end[-1] ) )
+        end--;
+
+    number->mantissa  = 0;
+    number->exponent  = 0;
+    number->truncated = false;
+    number->negative  = false;
+    number->special   = '\0';
+    if( p < end && (*p == '-' || *p == '+') ){
+        number->negative = *p == '-';
+        p++;
+    }
+    number->begin = p;
+    number->end   = end;
+    if( end-p == 3 && (memcmp( p, "INF", 3 ) == 0 || memcmp( p, "NaN", 3 ) == 0) ){
+        number->special = *p;
+        return true;
+    }
+
+    // significant digits go into the mantissa, leading zeros are
+    // dropped and digits beyond the 19th only scale the exponent
+    bool any = false;
+    int digits = 0;
+    for( ; p < end && xml_is_digit( *p ); p++ ){
+        any = true;
+        if( digits < 19 ){
+            number->mantissa = number->mantissa*10 + (*p-'0');
+            digits += number->mantissa != 0;
+        } else {
+            number->exponent++;
+            number->truncated |= *p != '0';
+        }
+    }
+    if( p < end && *p == '.' ){
+        for( p++; p < end && xml_is_digit( *p ); p++ ){
+            any = true;
+            if( digits < 19 ){
+                number->mantissa = number->mantissa*10 + (*p-'0');
+                digits += number->mantissa != 0;
+                number->exponent--;
+            } else {
+                number->truncated |= *p != '0';
+            }
+        }
+    }
+    if( !any )
+        return false;
+
+    if( p < end && (*p == 'e' || *p == 'E') ){
+        p++;
+        bool negative = false;
+        if( p < end && (*p == '-' || *p == '+') ){
+            negative = *p == '-';
+            p++;
+        }
+        if( p == end )
+            return false;
+        int exponent = 0;
+        for( ; p < end && xml_is_digit( *p ); p++ ){
+            if( exponent < 100000 )
+                exponent = exponent*10 + (*p-'0');
+        }
+        number->exponent += negative ? -exponent : exponent;
+    }
+    return p == end;
+}
+
+/**
+    Converts a scanned number which is not handled by the fast path,
+    see xml_span_to_double()
+
+    @param[in]  number  Number scanned by xml_scan_number()
+    @param[in]  as_float Whether to round to float rather than double
+    @return the correctly rounded value, without its sign
+*/
+static inline double xml_convert_number( const xml_decimal *number, bool as_float ){
+#if defined(XML_NUMBER_FROM_CHARS)
+    if( as_float ){
+        float value = 0.0f;
+        std::from_chars_result result = std::from_chars( number->begin, number->end, value );
+        if( result.ec == std::errc::result_out_of_range )
+            return number->mantissa != 0 && number->exponent > 0 ? HUGE_VAL : 0.0;
+        return value;
+    }
+    double value = 0.0;
+    std::from_chars_result result = std::from_chars( number->begin, number->end, value );
+    if( result.ec == std::errc::result_out_of_range )
+        return number->mantissa != 0 && number->exponent > 0 ? HUGE_VAL : 0.0;
+    return value;
+#else
+    // strtod() expects the decimal point of the current locale
+    const size_t len = number->end - number->begin;
+    char local[128];
+    std::string heap;
+    char *copy = local;
+    if( len >= sizeof(local) ){
+        heap.resize( len+1 );
+        copy = &heap[0];
+    }
+    const char point = localeconv()->decimal_point[0];
+    for( size_t i=0; i<len; i++ )
+        copy[i] = number->begin[i] == '.' ? point : number->begin[i];
+    copy[len] = '\0';
+    return as_float ? strtof( copy, NULL ) : strtod( copy, NULL );
+#endif
+}
+
+/**
+    Converts 'span' to a double, correctly rounded
+
+    @param[in]  span    Characters to convert, e.g. an attribute value
+    @param[out] value   The value, unchanged if the span is not a number
+    @return true if the span holds a number
+*/
+static inline bool xml_span_to_double( xml_span span, double *value ){
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    xml_decimal number;
+    if( !xml_scan_number( span, &number ) )
+        return false;
+
+    double result;
+    if( number.special ){
+        result = number.special == 'I' ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+    }
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    // the mantissa and the power of ten are exact, so a single
+    // operation gives the correctly rounded result
+    else if( !number.truncated && number.mantissa <= ((uint64_t)1 << 53) && number.exponent >= -22 && number.exponent <= 22 ){
+        result = (double)number.mantissa;
+        result = number.exponent < 0 ? result / powers[-number.exponent] : result * powers[number.exponent];
+    }
+#endif
+    else {
+        result = xml_convert_number( &number, false );
+    }
+    (void)powers;
+    *value = number.negative ? -result : result;
+    return true;
+}
+
+/**
+    Converts 'span' to a float, correctly rounded (rather than rounded
+    to double and then to float)
+
+    @param[in]  span    Characters to convert, e.g. an attribute value
+    @param[out] value   The value, unchanged if the span is not a number
+    @return true if the span holds a number
+*/
+static inline bool xml_span_to_float( xml_span span, float *value ){
+    static const float powers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+    xml_decimal number;
+    if( !xml_scan_number( span, &number ) )
+        return false;
+
+    float result;
+    if( number.special ){
+        result = number.special == 'I' ? std::numeric_limits<float>::infinity() : std::numeric_limits<float>::quiet_NaN();
+    }
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    else if( !number.truncated && number.mantissa <= ((uint64_t)1 << 24) && number.exponent >= -10 && number.exponent <= 10 ){
+        result = (float)number.mantissa;
+        result = number.exponent < 0 ? result / powers[-number.exponent] : result * powers[number.exponent];
+    }
+#endif
+    else {
+        result = (float)xml_convert_number( &number, true );
+    }
+    (void)powers;
+    *value = number.negative ? -result : result;
+    return true;
+}
+
+/**
+    Converts 'span' to a 64 bit integer. Only an optional sign followed
+    by decimal digits is accepted, surrounded by optional whitespace.
+
+    @param[in]  span    Characters to convert, e.g. an attribute value
+    @param[out] value   The value, unchanged if the span is not an integer
+    @return true if the span holds an integer within the range of int64_t
+*/
+static inline bool xml_span_to_int64( xml_span span, int64_t *value ){
+    const char *p = span.str, *end = span.str+span.len;
+    while( p < end && xml_is_space( *p ) )
+        p++;
+    while( end > p && xml_is_space( end[-1] ) )
+        end--;
+    bool negative = false;
+    if( p < end && (*p == '-' || *p == '+') ){
+        negative = *p == '-';
+        p++;
+    }
+    if( p == end )
+        return false;
+
+    const uint64_t limit = (uint64_t)std::numeric_limits<int64_t>::max() + negative;
+    uint64_t result = 0;
+    for( ; p < end; p++ ){
+        if( !xml_is_digit( *p ) )
+            return false;
+        const unsigned digit = *p-'0';
+        if( result > (limit-digit)/10 )
+            return false;
+        result = result*10 + digit;
+    }
+    *value = negative ? (int64_t)(0-result) : (int64_t)result;
+    return true;
+}
+
+/**
+    Converts a run of 1 to 8 digits to its value, eight bytes at a
+    time: the digits are aligned to the top of a word as the low
+    digits of an eight digit number, then adjacent digits, pairs and
+    quadruples are combined with three multiplications. At least 8
+    characters must be readable from 'p'.
+
+    @param[in]  p   First digit
+    @param[in]  len Number of digits, 1 to 8
+    @return the value of the digits
+*/
+static inline uint32_t xml_parse_eight_digits( const char *p, size_t len ){
+    uint64_t word;
+    memcpy( &word, p, 8 );
+    // characters after the digits are shifted out, their place taken
+    // by leading zeros; borrows from them only move into those bytes
+    word = (word - XML_U64( 0x3030303030303030 )) << (8*(8-len));
+    word = (word * 10) + (word >> 8);
+    word = (((word & XML_U64( 0x000000FF000000FF )) * (100 + (XML_U64( 1000000 ) << 32))) +
+            (((word >> 16) & XML_U64( 0x000000FF000000FF )) * (1 + (XML_U64( 10000 ) << 32)))) >> 32;
+    return (uint32_t)word;
+}
+
+/**
+    Reads an integer with an optional sign from [p,end)
+
+    @param[in]  p       Start of the integer
+    @param[in]  end     End of the range
+    @param[out] value   The value read
+    @return pointer past the integer, or NULL if there is no integer
+            at p or it does not fit in an int32_t
+*/
+static inline const char *xml_read_int32( const char *p, const char *end, int32_t *value ){
+    bool negative = false;
+    if( p < end && (*p == '-' || *p == '+') ){
+        negative = *p == '-';
+        p++;
+    }
+    const size_t len = xml_digit_run( p, end );
+    if( len == 0 )
+        return NULL;
+
+    uint64_t result = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if( len <= 8 && end-p >= 8 ){
+        result = xml_parse_eight_digits( p, len );
+    } else
+#endif
+    {
+        for( size_t i=0; i<len && result <= (uint64_t)0x80000000; i++ )
+            result = result*10 + (p[i]-'0');
+    }
+    if( result > (uint64_t)0x7FFFFFFF + negative )
+        return NULL;
+    *value = (int32_t)(negative ? -(int64_t)result : (int64_t)result);
+    return p+len;
+}
+
+/**
+    Reads a number in the syntax of xml_span_to_double() from [p,end),
+    up to the next whitespace or comma
+
+    @param[in]  p       Start of the number
+    @param[in]  end     End of the range
+    @param[out] value   The value read
+    @return pointer past the number, or NULL if there is no number at p
+*/
+static inline const char *xml_read_double( const char *p, const char *end, double *value ){
+    const char *q = p;
+    while( q < end && *q != ',' && !xml_is_space( *q ) )
+        q++;
+    if( q == p || !xml_span_to_double( xml_make_span( p, q-p ), value ) )
+        return NULL;
+    return q;
+}
+
+/**
+    Skips the separator following a value of a list: whitespace, at
+    most one comma, and whitespace
+
+    @param[in]  p       Character following the value
+    @param[in]  end     End of the list
+    @return pointer to the next value or 'end', or NULL if there is
+            no separator or the list ends with a comma
+*/
+static inline const char *xml_skip_list_separator( const char *p, const char *end ){
+    if( p < end && *p == ',' && p+1 < end && !xml_is_space( p[1] ) )
+        return p+1;
+    const char *q = xml_skip_space( p, end );
+    if( q < end && *q == ',' ){
+        q = xml_skip_space( q+1, end );
+        return q < end ? q : NULL;
+    }
+    return q == p && q < end ? NULL : q;
+}
+
+/**
+    Reads the list of numbers in 'span' into 'values', using 'read'
+    to read each number
+
+    @param[in]  span        Characters to read
+    @param[out] values      Buffer receiving the values
+    @param[in]  capacity    Number of values that fit in 'values'
+    @param[out] count       Number of values read, may be NULL
+    @param[in]  read        Function reading a single value
+    @return true if the whole span was read and every value fitted
+*/
+template< typename Value >
+inline bool xml_read_list( xml_span span, Value *values, size_t capacity, size_t *count, const char *(*read)( const char*, const char*, Value* ) ){
+    const char *p = xml_skip_space( span.str, span.str+span.len ), *end = span.str+span.len;
+    size_t n = 0;
+    while( p && p < end && n < capacity ){
+        p = read( p, end, &values[n] );
+        if( p ){
+            n++;
+            p = xml_skip_list_separator( p, end );
+        }
+    }
+    if( count )
+        *count = n;
+    return p == end;
+}
+
+/**
+    Appends the list of numbers in 'span' to 'values', see xml_read_list()
+*/
+template< typename Value >
+inline bool xml_append_list( xml_span span, std::vector<Value> *values, const char *(*read)( const char*, const char*, Value* ) ){
+    const char *p = xml_skip_space( span.str, span.str+span.len ), *end = span.str+span.len;
+    // allow for typical values of a few digits, the vector grows as
+    // usual if they are shorter, so no worst-case buffer is filled
+    values->reserve( values->size() + span.len/8 + 1 );
+    Value value;
+    while( p && p < end ){
+        p = read( p, end, &value );
+        if( p ){
+            values->push_back( value );
+            p = xml_skip_list_separator( p, end );
+        }
+    }
+    return p == end;
+}
+
+/**
+    Reads a list of integers separated by commas and/or whitespace,
+    e.g. the text "197,335,394", into a caller-provided buffer
+
+    @param[in]  span        Characters to read, e.g. the text of a tag
+    @param[out] values      Buffer receiving the values
+    @param[in]  capacity    Number of values that fit in 'values'
+    @param[out] count       Number of values read, may be NULL
+    @return true if the whole span was read and every value fitted in
+            an int32_t and in the buffer
+*/
+static inline bool xml_span_to_int32_array( xml_span span, int32_t *values, size_t capacity, size_t *count ){
+    return xml_read_list( span, values, capacity, count, xml_read_int32 );
+}
+
+/**
+    Appends a list of integers separated by commas and/or whitespace
+    to 'values', see xml_span_to_int32_array()
+
+    @param[in]  span    Characters to read, e.g. the text of a tag
+    @param[out] values  Vector the values are appended to
+    @return true if the whole span was read, otherwise the values
+            read before the error are appended
+*/
+static inline bool xml_span_to_int32_vector( xml_span span, std::vector<int32_t> *values ){
+    return xml_append_list( span, values, xml_read_int32 );
+}
+
+/**
+    Reads a list of numbers separated by commas and/or whitespace into
+    a caller-provided buffer, see xml_span_to_double()
+
+    @param[in]  span        Characters to read, e.g. the text of a tag
+    @param[out] values      Buffer receiving the values
+    @param[in]  capacity    Number of values that fit in 'values'
+    @param[out] count       Number of values read, may be NULL
+    @return true if the whole span was read and every value fitted in
+            the buffer
+*/
+static inline bool xml_span_to_double_array( xml_span span, double *values, size_t capacity, size_t *count ){
+    return xml_read_list( span, values, capacity, count, xml_read_double );
+}
+
+/**
+    Appends a list of numbers separated by commas and/or whitespace to
+    'values', see xml_span_to_double_array()
+
+    @param[in]  span    Characters to read, e.g. the text of a tag
+    @param[out] values  Vector the values are appended to
+    @return true if the whole span was read, otherwise the values
+            read before the error are appended
+*/
+static inline bool xml_span_to_double_vector( xml_span span, std::vector<double> *values ){
+    return xml_append_list( span, values, xml_read_double );
+}
+
+#endif
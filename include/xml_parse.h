@@ -9,13 +9,179 @@
  */
 
 
-#include<ctype.h>
 #include<cstdio>
 #include<cstdarg>
 #include<cstdlib>
+#include<cstring>
 #include<vector>
+#include<deque>
 #include<string>
 
+#include"xml_simd.h"
+
+/**
+    Default limit on element nesting depth applied by xml_init_state(),
+    may be overridden by defining it before including this header or
+    per-parse by setting xml_state::max_depth
+*/
+#ifndef XML_DEFAULT_MAX_DEPTH
+#define XML_DEFAULT_MAX_DEPTH 1024
+#endif
+
+/**
+    Defined when building without exception support (e.g. with
+    -fno-exceptions), or by the user to stop the parser throwing. Errors
+    are then only reported through the return values and xml_error_info.
+*/
+#if !defined(XML_NO_EXCEPTIONS) && !defined(__cpp_exceptions) && !defined(__EXCEPTIONS) && !defined(_CPPUNWIND)
+#define XML_NO_EXCEPTIONS
+#endif
+
+/**
+    @brief Non-owning view of a run of characters within the document
+    being parsed.  Spans are not null-terminated and are only valid
+    for as long as the buffer passed to the parser remains alive.
+    Values in which references were decoded instead point into the
+    parser state and are valid until the next token is read.
+*/
+typedef struct {
+    /** pointer to the first character of the span */
+    const char              *str;
+    
+    /** number of characters in the span */
+    size_t                  len;
+} xml_span;
+
+/**
+    @brief Name and value of an attribute, see xml_handler::attributes()
+*/
+typedef struct {
+    /** name of the attribute */
+    xml_span                name;
+    
+    /** value of the attribute, without the quotes */
+    xml_span                value;
+} xml_attribute;
+
+/**
+    @brief Result of reading a token, or of feeding input to the parser
+*/
+typedef enum {
+    /** a token was read, or the input provided was accepted */
+    XML_OK,
+    /** the available input ends partway through a token, the token
+        has not been consumed and will be re-read once more input
+        has been provided */
+    XML_INCOMPLETE,
+    /** the end of the input was reached */
+    XML_DONE,
+    /** the document is malformed, see xml_get_error() */
+    XML_ERROR,
+    /** the handler asked to stop (see xml_handler::stop_requested()),
+        the position reached is recorded as an XML_ERROR_STOPPED error */
+    XML_STOPPED
+} xml_status;
+
+/**
+    @brief Kind of error detected by the parser, see xml_error_info
+*/
+typedef enum {
+    /** no error occurred */
+    XML_ERROR_NONE = 0,
+    /** a character did not match the grammar, see 'expected' and 'actual' */
+    XML_ERROR_UNEXPECTED_CHAR,
+    /** a quoted attribute value has no closing quote */
+    XML_ERROR_UNTERMINATED_STRING,
+    /** a comment has no closing --&gt; */
+    XML_ERROR_UNTERMINATED_COMMENT,
+    /** a closing tag does not match the open tag, named in 'expected' */
+    XML_ERROR_TAG_MISMATCH,
+    /** a closing tag was found with no tag open */
+    XML_ERROR_UNEXPECTED_CLOSE,
+    /** the input ended while a tag, named in 'expected', was open */
+    XML_ERROR_UNCLOSED_TAG,
+    /** an &lt;?xml ...?&gt; header appears after the start of the document */
+    XML_ERROR_MISPLACED_HEADER,
+    /** more than xml_state::max_depth tags are open */
+    XML_ERROR_DEPTH_EXCEEDED,
+    /** a token is larger than the limit of a streaming parser */
+    XML_ERROR_TOKEN_TOO_LARGE,
+    /** the buffer is not followed by the '\0' sentinel */
+    XML_ERROR_NO_SENTINEL,
+    /** reading the input failed */
+    XML_ERROR_READ,
+    /** not an error: the handler stopped parsing at 'offset', see
+        xml_handler::stop_requested() */
+    XML_ERROR_STOPPED,
+    /** a CDATA section has no closing ]]&gt; */
+    XML_ERROR_UNTERMINATED_CDATA,
+    /** the input file could not be opened, see 'system_error' */
+    XML_ERROR_OPEN
+} xml_error_code;
+
+/**
+    @brief Description of the first error found in a document, or of
+    the position at which the handler stopped parsing. Nothing but the
+    position is recorded while parsing, the line and column are only
+    computed when the error is retrieved with xml_get_error().
+*/
+typedef struct {
+    /** kind of error, XML_ERROR_NONE if there was none */
+    xml_error_code          code;
+    
+    /** offset of the error from the start of the document */
+    size_t                  offset;
+    
+    /** line number of the error, starting from 1 */
+    int                     line;
+    
+    /** column number of the error, starting from 1 */
+    int                     column;
+    
+    /** description of what was expected at the error, may be empty */
+    char                    expected[64];
+    
+    /** character found at the error, '\0' at the end of the input */
+    char                    actual;
+    
+    /** errno of the failed call for XML_ERROR_OPEN and XML_ERROR_READ,
+        zero otherwise */
+    int                     system_error;
+} xml_error_info;
+
+/**
+    @brief Kind of event returned by xml_pull_parser::next(), named
+    after the corresponding callbacks
+*/
+typedef enum {
+    /** a tag was started, 'name' holds its name */
+    XML_EVENT_BEGIN_TAG,
+    /** a tag was ended, 'name' holds its name */
+    XML_EVENT_END_TAG,
+    /** text within a tag was read, 'value' holds the text */
+    XML_EVENT_TAG_TEXT,
+    /** a comment was read, 'value' holds the comment text */
+    XML_EVENT_COMMENT,
+    /** an attribute of the current tag was read, 'name' and 'value' hold it */
+    XML_EVENT_ATTRIBUTE,
+    /** a CDATA section was read, 'value' holds its content */
+    XML_EVENT_CDATA
+} xml_event_type;
+
+/**
+    @brief A single parser event, see xml_pull_parser
+*/
+typedef struct {
+    /** kind of event */
+    xml_event_type          type;
+    
+    /** tag or attribute name, empty for text, comments and CDATA */
+    xml_span                name;
+    
+    /** attribute value, text, comment or CDATA content, empty for tags */
+    xml_span                value;
+} xml_event;
+
 /**
     @brief Structure to hold user-callbacks for the xml-parser.  This is the
     mechanism by which data from the document is provided to the user.
@@ -38,30 +204,236 @@ typedef struct {
     
     /** called whenever a tag attribute is read */ 
     void (*attribute)( void *user_data, std::string &name, std::string &value );
+    
+    /** set non-zero by a callback to stop parsing after the current
+        event, see xml_handler::stop_requested() */
+    int stop;
+    
+    /** called whenever a CDATA section is read, may be NULL */
+    void (*cdata    )( void *user_data, std::string &text );
 } xml_callbacks;
 
 /**
-    @brief Structure to hold the current state of the parser. Currently
-    data is passed to the parser in the character array 'buffer'
-    however this will likely change in subsequent versions.
+    @brief Zero-copy counterpart of xml_callbacks. Names, values, text
+    and comments are delivered as spans pointing directly into the
+    caller's buffer, so no heap allocation is performed per event.
+    Any callback may be left NULL if the user is not interested in
+    the corresponding event.
 */
 typedef struct {
-    /** character buffer holding the raw xml data */
-    std::string             buffer;
+    /** pointer set by the user which is passed as an argument to all callbacks */
+    void *user_data;
     
-    /** integer character index for the xml stream, relative to the start of 'buffer' */
-    int                     pos;
+    /** called whenever a new tag is started */
+    void (*begin_tag)( void *user_data, xml_span name );
+    
+    /** called whenever a tag is ended */
+    void (*end_tag  )( void *user_data, xml_span name );
+    
+    /** called whenever the text for a tag is read */
+    void (*tag_text )( void *user_data, xml_span text );
+    
+    /** called whenever a comment is read */
+    void (*comment  )( void *user_data, xml_span comment );
+    
+    /** called whenever a tag attribute is read */
+    void (*attribute)( void *user_data, xml_span name, xml_span value );
     
-    /** line-number of position within the xml stream, determined by counting newlines */
-    int                     line_number;
+    /** called after begin_tag, may be NULL. Returning non-zero skips the
+        attributes and content of the tag, see xml_handler::begin_tag */
+    int  (*skip_tag )( void *user_data, xml_span name );
+    
+    /** set non-zero by a callback to stop parsing after the current
+        event, e.g. by passing the callbacks themselves as user_data,
+        see xml_handler::stop_requested() */
+    int stop;
+    
+    /** may be NULL, if set it is called once per start tag with all of
+        the tag's attributes instead of calling 'attribute' for each */
+    void (*attributes)( void *user_data, xml_span name, const xml_attribute *attributes, size_t count );
+    
+    /** called whenever a CDATA section is read, may be NULL */
+    void (*cdata    )( void *user_data, xml_span text );
+} xml_span_callbacks;
+
+/**
+    @brief Structure to hold the current state of the parser. The
+    parser does not copy the document, the data in [begin,end) is
+    borrowed from the caller and must outlive the parse. The character
+    at 'end' must be readable and equal to '\0': it acts as a sentinel
+    that terminates every scanning loop, so the parser never needs to
+    bounds-check individual characters. Either (or both) of 'callbacks'
+    and 'span_callbacks' may be set to receive events.
+*/
+typedef struct {
+    /** pointer to the first character of the raw xml data, owned by the caller */
+    const char              *begin;
     
-    /** column number of position within the xml stream, determined by counting characters */
-    int                     column_number;
+    /** pointer one past the last character of the xml data, must point at a '\0' */
+    const char              *end;
+    
+    /** current position of the parser within [begin,end] */
+    const char              *cur;
+    
+    /** true if no input follows 'end'. When false (push parsing) a token
+        which runs into 'end' is incomplete rather than malformed */
+    bool                    final;
+    
+    /** offset of 'begin' from the start of the document, non-zero once
+        consumed input has been released by xml_release_input() */
+    size_t                  stream_offset;
+    
+    /** line and column number of the character at 'begin' */
+    int                     begin_line;
+    int                     begin_column;
+    
+    /** position up to which newlines have been counted by xml_location(), line
+        numbers are only computed when requested (e.g. for error reporting) so
+        the parser does no per-character line tracking */
+    const char              *line_pos;
+    
+    /** line number of 'line_pos', i.e. begin_line plus the newlines in [begin,line_pos) */
+    int                     line_count;
     
     /** pointer to the xml_callbacks structure which the parser uses to communicate with the user */
     xml_callbacks           *callbacks;
+    
+    /** pointer to the zero-copy callbacks, used in addition to 'callbacks' if non-NULL */
+    xml_span_callbacks      *span_callbacks;
+    
+    /** offsets into 'stack_names' of the names of the currently open
+        elements, innermost last. Elements are parsed iteratively using
+        this stack rather than by recursion, so native stack usage does
+        not depend on document depth. The names are copied so that they
+        remain valid when consumed input is released. The storage is
+        reused if the state is reused for another document. */
+    std::vector<size_t>     stack;
+    
+    /** concatenated names of the open elements */
+    std::string             stack_names;
+    
+    /** maximum number of nested open elements before parsing fails,
+        zero or negative for no limit */
+    int                     max_depth;
+    
+    /** true once the first token of the document has been read */
+    bool                    started;
+    
+    /** number of characters after the current position already known not
+        to contain the terminator of the token there, so that scanning of
+        an incomplete token resumes where it left off */
+    size_t                  resume;
+    
+    /** true if the characters passed over by 'resume' contain a '&' */
+    bool                    resume_references;
+    
+    /** values of the current token in which references were decoded,
+        see xml_decode_span(). A deque is used so that values already
+        handed out never move, and the strings are reused by later
+        tokens so that their storage is allocated once. */
+    std::deque<std::string> decoded;
+    
+    /** number of entries of 'decoded' in use by the current token */
+    size_t                  decoded_count;
+    
+    /** number of open elements whose content is being skipped, see
+        xml_skip_content(), zero when not skipping */
+    size_t                  skip_depth;
+    
+    /** attributes of the start tag being read, for handlers which take
+        them all at once (see xml_handler::attributes()). The storage
+        only grows, so that it is allocated once per document. */
+    std::vector<xml_attribute> attributes;
+    
+    /** first error found in the document, see xml_get_error() */
+    xml_error_info          error;
+    
+    /** position of 'error' within [begin,end] */
+    const char              *error_pos;
 } xml_state;
 
+/**
+    @brief Builds a span from a pointer and length
+ 
+    @param[in]  str Pointer to the first character
+    @param[in]  len Number of characters
+    @return span covering [str, str+len)
+*/
+static inline xml_span xml_make_span( const char *str, size_t len ){
+    xml_span span = { str, len };
+    return span;
+}
+
+/**
+    @brief Copies the characters referenced by a span into a std::string
+ 
+    @param[in]  span Span to convert
+    @return newly allocated string holding the span contents
+*/
+static inline std::string xml_span_to_string( xml_span span ){
+    return std::string( span.str, span.len );
+}
+
+/**
+    @brief Returns true if two spans contain the same characters
+ 
+    @param[in]  a First span
+    @param[in]  b Second span
+    @return true if a and b have equal length and contents
+*/
+static inline bool xml_span_equals( xml_span a, xml_span b ){
+    return a.len == b.len && memcmp( a.str, b.str, a.len ) == 0;
+}
+
+/**
+    @brief Returns true if a span matches a null-terminated string
+ 
+    @param[in]  a   Span to test
+    @param[in]  str Null-terminated string to compare against
+    @return true if a has the same contents as str
+*/
+static inline bool xml_span_equals( xml_span a, const char *str ){
+    return xml_span_equals( a, xml_make_span( str, strlen(str) ) );
+}
+
+/**
+    @brief Initializes a parser state to read from a caller-owned buffer.
+    The buffer is not copied and must remain valid while parsing.
+    buffer[size] must be a readable '\0' (as is always the case for
+    std::string::c_str()), which the parser uses as a sentinel.
+ 
+    @param[out] state       Parser state to initialize
+    @param[in]  buffer      Pointer to the xml data
+    @param[in]  size        Number of characters in buffer, not counting the sentinel
+    @param[in]  callbacks   Callbacks receiving std::string events, may be NULL
+    @param[in]  span_callbacks Callbacks receiving zero-copy span events, may be NULL
+*/
+static inline void xml_init_state( xml_state *state, const char *buffer, size_t size, xml_callbacks *callbacks, xml_span_callbacks *span_callbacks=NULL ){
+    state->begin          = buffer;
+    state->end            = buffer+size;
+    state->cur            = buffer;
+    state->final          = true;
+    state->stream_offset  = 0;
+    state->begin_line     = 0;
+    state->begin_column   = 0;
+    state->line_pos       = buffer;
+    state->line_count     = 0;
+    state->callbacks      = callbacks;
+    state->span_callbacks = span_callbacks;
+    state->max_depth      = XML_DEFAULT_MAX_DEPTH;
+    state->stack.clear();
+    state->stack_names.clear();
+    state->started        = false;
+    state->resume         = 0;
+    state->resume_references = false;
+    state->decoded_count  = 0;
+    state->skip_depth     = 0;
+    // clear every field, so that copies made when there is no error
+    // hold zeros rather than indeterminate values
+    memset( &state->error, 0, sizeof(state->error) );
+    state->error_pos      = NULL;
+}
+
 /**
     @brief function to indicate whether the end of the stream has
     been reached
@@ -69,35 +441,123 @@ typedef struct {
     @param[in] state Current parser state
 */
 static inline bool xml_eof( xml_state *state ){
-    return state->pos == (int)state->buffer.size();
+    return state->cur >= state->end;
+}
+
+/**
+    @brief Returns the offset of position 'p' from the start of the
+    document, which may lie outside the current buffer when parsing
+    input in pieces
+ 
+    @param[in] state Current parser state
+    @param[in] p     Position within [begin,end]
+    @return number of characters of the document preceding 'p'
+*/
+static inline size_t xml_stream_offset( xml_state *state, const char *p ){
+    return state->stream_offset + (size_t)(p - state->begin);
 }
 
 /**
-    @brief Error logging function for the xml-parser, dumps out the 
-    file and line number (currently these are only done at 
-    the current location, i.e. within the error function itself,
-    which is kind of stupid). Then it throws an error to 
-    halt further processing.
+    @brief Reports a fatal error which is not specific to a document by
+    printing the message to stderr, then throwing to halt further
+    processing (or aborting when built with XML_NO_EXCEPTIONS)
  
     @param[in]  fmt printf style formatting for variable argument list
  */
-static void xml_error( const char *fmt, ... ){
+static inline void xml_error( const char *fmt, ... ){
     va_list args;
     va_start (args, fmt);
-    fprintf( stderr, "Error in %s line %d: ", __FILE__, __LINE__ );
+    fprintf( stderr, "Error: " );
     vfprintf( stderr, fmt, args );
     va_end ( args );
+#if defined(XML_NO_EXCEPTIONS)
+    abort();
+#else
     throw "xml_fatal_error";
+#endif
+}
+
+/**
+    @brief Records an error at position 'p' in the parser state, unless
+    one has already been recorded. Only the position is stored, see
+    xml_get_error().
+ 
+    @param[in]  state    Current parser state
+    @param[in]  p        Position of the error within [begin,end]
+    @param[in]  code     Kind of error
+    @param[in]  expected Description of what was expected, may be NULL
+    @return false, so that scanners can return the result directly
+ */
+static inline bool xml_set_error( xml_state *state, const char *p, xml_error_code code, const char *expected ){
+    if( state->error.code != XML_ERROR_NONE )
+        return false;
+    state->error.code   = code;
+    state->error.offset = xml_stream_offset( state, p );
+    state->error.line   = 0;
+    state->error.column = 0;
+    state->error.actual = p < state->end ? *p : '\0';
+    state->error.system_error = 0;
+    snprintf( state->error.expected, sizeof(state->error.expected), "%s", expected ? expected : "" );
+    state->error_pos    = p;
+    return false;
+}
+
+/**
+    @brief Called by the scanners when the input at 'p' does not match
+    the grammar. If 'p' is at the end of the available input and more
+    input may follow (xml_state::final is false) the token being read
+    is incomplete rather than malformed, so nothing is recorded.
+    Otherwise the error is recorded with xml_set_error(). Either way
+    false is returned for the caller to abandon the token.
+ 
+    @param[in]  state    Current parser state
+    @param[in]  p        Position at which the input failed to match
+    @param[in]  code     Kind of error
+    @param[in]  expected Description of what was expected, may be NULL
+    @return false
+ */
+static inline bool xml_fail( xml_state *state, const char *p, xml_error_code code, const char *expected ){
+    if( p >= state->end && !state->final )
+        return false;
+    return xml_set_error( state, p, code, expected );
 }
 
 /**
-    Returns true if the character 'c' is a whitespace character
+    @brief Returns a description of an error code
+ 
+    @param[in]  code    Error code
+    @return static, null-terminated description
+ */
+static inline const char *xml_error_string( xml_error_code code ){
+    switch( code ){
+        case XML_ERROR_NONE:                 return "no error";
+        case XML_ERROR_UNEXPECTED_CHAR:      return "unexpected character";
+        case XML_ERROR_UNTERMINATED_STRING:  return "unterminated string";
+        case XML_ERROR_UNTERMINATED_COMMENT: return "unterminated comment";
+        case XML_ERROR_TAG_MISMATCH:         return "closing tag does not match the open tag";
+        case XML_ERROR_UNEXPECTED_CLOSE:     return "closing tag with no open tag";
+        case XML_ERROR_UNCLOSED_TAG:         return "unexpected end of input with a tag open";
+        case XML_ERROR_MISPLACED_HEADER:     return "header tag midway through the document";
+        case XML_ERROR_DEPTH_EXCEEDED:       return "maximum nesting depth exceeded";
+        case XML_ERROR_TOKEN_TOO_LARGE:      return "token exceeds the maximum size";
+        case XML_ERROR_NO_SENTINEL:          return "buffer must be followed by a '\\0' sentinel";
+        case XML_ERROR_READ:                 return "error reading input";
+        case XML_ERROR_STOPPED:              return "parsing stopped by the handler";
+        case XML_ERROR_UNTERMINATED_CDATA:   return "unterminated CDATA section";
+        case XML_ERROR_OPEN:                 return "error opening input";
+    }
+    return "unknown error";
+}
+
+/**
+    Returns true if the character 'c' is an xml whitespace character,
+    i.e. space, tab, carriage return or newline
  
     @param[in]  c Input character to be tested
     @return true if c is a whitespace character, false otherwise
 */
 static inline bool xml_is_space( char c ){
-    return isspace( c );
+    return ( xml_char_class( c ) & XML_CHAR_SPACE ) != 0;
 }
 
 /**
@@ -107,7 +567,7 @@ static inline bool xml_is_space( char c ){
     @return true if 'c' is a digit, false otherwise
  */
 static inline bool xml_is_digit( char c ){
-    return isdigit( c );
+    return ( xml_char_class( c ) & XML_CHAR_DIGIT ) != 0;
 }
 
 /**
@@ -117,25 +577,40 @@ static inline bool xml_is_digit( char c ){
     @return true if 'c' is an alphabetic character false otherwise
  */
 static inline bool xml_is_alpha( char c ){
-    return isalpha( c );
+    return ( xml_char_class( c ) & XML_CHAR_ALPHA ) != 0;
+}
+
+/**
+    returns true if the character 'c' may start a tag or attribute
+    name, i.e. a letter, an underscore, a colon or any byte of a
+    multi-byte UTF-8 sequence
+ 
+    @param[in]  c Input character to be tested
+    @return true if 'c' can begin an xml name, false otherwise
+ */
+static inline bool xml_is_name_start_char( char c ){
+    return ( xml_char_class( c ) & XML_CHAR_NAME_START ) != 0;
 }
 
 /**
     returns true if the character 'c' is a valid character for a
-    tag or attribute name, currently defined as either a letter,
-    a digit or an underscore
+    tag or attribute name, i.e. a name start character, a digit,
+    a hyphen or a period
  
     @param[in]  c Input character to be tested
     @return true if 'c' is a valid character for an xml name, 
             false otherwise
  */
 static inline bool xml_is_valid_name_char( char c ){
-    return xml_is_alpha(c) || xml_is_digit(c) || c == '_';
+    return ( xml_char_class( c ) & XML_CHAR_NAME ) != 0;
 }
 
 /**
     Peeks at and returns a character that is offset characters
-    from the current stream position.
+    from the current stream position. No bounds check is performed:
+    the '\0' sentinel at the end of the buffer makes peeking at the
+    current position always safe, and peeking at offset n is safe
+    provided the characters before it are known not to be '\0'.
     
     @param[in]  state   Current parser state
     @param[in]  offset  Offset of character to return from current
@@ -143,119 +618,452 @@ static inline bool xml_is_valid_name_char( char c ){
     @return Character value offset bytes from the current stream position
 */
 static inline char xml_peek( xml_state *state, int offset=0 ){
-    int fpos = state->pos+offset;
-    if( fpos >= 0 && fpos < (int)state->buffer.size() )
-        return state->buffer[state->pos+offset];
-    xml_error("xml_peek(): tried to accces buffer index %d, valid range [0,%d]", fpos, state->buffer.size() );
-    return '\0';
+    return state->cur[offset];
 }
 
 /**
-    Advances the stream by a single character and tracks line
-    and column number of the stream for error reporting
+    Advances the stream to position 'p'
+ 
+    @param[in] state Current parser state
+    @param[in] p     New stream position, at or after the current one
+*/
+static inline void xml_advance_to( xml_state *state, const char *p ){
+    state->cur = p;
+}
+
+/**
+    Advances the stream by a single character
  
     @param[in] state Current parser state
 */
 static inline void xml_advance( xml_state *state ){
-    if( state->buffer[state->pos] == '\n' ){
-        state->line_number++;
-        state->column_number = 0;
-    } else {
-        state->column_number++;
+    state->cur++;
+}
+
+/**
+    Computes the line and column number of position 'p' within the
+    stream. Nothing is tracked while parsing, instead newlines are
+    counted on demand. Counting resumes from the last position that
+    was queried, so repeated queries moving forward through the
+    document only scan each character once.
+ 
+    @param[in]  state   Current parser state
+    @param[in]  p       Position within [begin,end] to locate
+    @param[out] line    Line number of 'p', starting from 0
+    @param[out] column  Column number of 'p', starting from 0
+*/
+static inline void xml_location( xml_state *state, const char *p, int *line, int *column ){
+    if( p < state->line_pos ){
+        state->line_pos   = state->begin;
+        state->line_count = state->begin_line;
+    }
+    
+    // branch-free count so that the loop can be vectorized
+    int newlines = 0;
+    for( const char *q=state->line_pos; q<p; q++ ){
+        newlines += (*q == '\n');
+    }
+    state->line_count += newlines;
+    state->line_pos    = p;
+    
+    const char *line_start = p;
+    while( line_start > state->begin && line_start[-1] != '\n' ){
+        line_start--;
+    }
+    *line   = state->line_count;
+    *column = (int)(p-line_start) + ( line_start == state->begin ? state->begin_column : 0 );
+}
+
+/**
+    Returns the line number of the current stream position, see
+    xml_location()
+ 
+    @param[in]  state   Current parser state
+    @return line number of the current position, starting from 0
+*/
+static inline int xml_line_number( xml_state *state ){
+    int line, column;
+    xml_location( state, state->cur, &line, &column );
+    return line;
+}
+
+/**
+    Retrieves the error recorded while parsing, computing its line
+    and column number
+ 
+    @param[in]  state   Current parser state
+    @param[out] info    Error description, info->code is XML_ERROR_NONE
+                        if no error was found, or XML_ERROR_STOPPED with
+                        the position reached if the handler stopped parsing
+    @return true if an error was found
+*/
+static inline bool xml_get_error( xml_state *state, xml_error_info *info ){
+    *info = state->error;
+    if( info->code == XML_ERROR_NONE )
+        return false;
+    xml_location( state, state->error_pos, &info->line, &info->column );
+    info->line++;
+    info->column++;
+    return info->code != XML_ERROR_STOPPED;
+}
+
+/**
+    Prints a description of 'info' to stderr, then throws to halt
+    further processing unless built with XML_NO_EXCEPTIONS
+ 
+    @param[in]  info    Error to report
+*/
+static inline void xml_raise_error( const xml_error_info *info ){
+    fprintf( stderr, "Error: %s", xml_error_string( info->code ) );
+    if( info->expected[0] )
+        fprintf( stderr, ", expected %s", info->expected );
+    if( info->code == XML_ERROR_UNEXPECTED_CHAR ){
+        if( info->actual )
+            fprintf( stderr, ", got '%c'", info->actual );
+        else
+            fprintf( stderr, ", got end of input" );
     }
-    state->pos++;
+    if( info->system_error )
+        fprintf( stderr, " (%s)", strerror( info->system_error ) );
+    if( info->code == XML_ERROR_OPEN )
+        fprintf( stderr, "\n" );
+    else
+        fprintf( stderr, " at input line %d, column %d (offset %lu)\n", info->line, info->column, (unsigned long)info->offset );
+#if !defined(XML_NO_EXCEPTIONS)
+    throw "xml_fatal_error";
+#endif
+}
+
+/**
+    Completes a call to one of the whole-document functions. If 'error'
+    is non-NULL it receives the outcome, including the position reached
+    when the handler stopped parsing, otherwise an error is reported
+    with xml_raise_error().
+ 
+    @param[in]  state   Parser state after parsing
+    @param[out] error   Error description, or NULL to report errors
+    @return true if no error was found
+*/
+static inline bool xml_report_status( xml_state *state, xml_error_info *error ){
+    xml_error_info info;
+    if( !xml_get_error( state, error ? error : &info ) )
+        return true;
+    if( !error )
+        xml_raise_error( &info );
+    return false;
+}
+
+/**
+    Records that the handler asked to stop at the current position
+ 
+    @param[in]  state   Current parser state
+    @return false, so that readers can return the result directly
+*/
+static inline bool xml_set_stopped( xml_state *state ){
+    return xml_set_error( state, state->cur, XML_ERROR_STOPPED, NULL );
+}
+
+/**
+    Returns the result of a token which could not be read: XML_INCOMPLETE
+    if the input ended, otherwise XML_ERROR or XML_STOPPED as recorded
+ 
+    @param[in]  state   Current parser state
+    @return status to return from xml_read_token()
+*/
+static inline xml_status xml_failure_status( xml_state *state ){
+    switch( state->error.code ){
+        case XML_ERROR_NONE:    return XML_INCOMPLETE;
+        case XML_ERROR_STOPPED: return XML_STOPPED;
+        default:                return XML_ERROR;
+    }
+}
+
+/**
+    Releases the input preceding the current position, after which
+    the parser no longer refers to it. Line and column bookkeeping
+    and the stream offset are carried over, so the owner of the
+    buffer may then discard the consumed characters and move the
+    remainder elsewhere with xml_relocate_input().
+ 
+    @param[in]  state   Current parser state
+*/
+static inline void xml_release_input( xml_state *state ){
+    int line, column;
+    xml_location( state, state->cur, &line, &column );
+    state->stream_offset = xml_stream_offset( state, state->cur );
+    state->begin_line    = line;
+    state->begin_column  = column;
+    state->begin         = state->cur;
+}
+
+/**
+    Points the parser at a new buffer which begins with the characters
+    that followed the current position, e.g. after the unconsumed input
+    has been moved and more appended. Must be preceded by
+    xml_release_input(). buffer[size] must be '\0'.
+ 
+    @param[in]  state   Current parser state
+    @param[in]  buffer  New input, starting at the current position
+    @param[in]  size    Number of characters in buffer
+*/
+static inline void xml_relocate_input( xml_state *state, const char *buffer, size_t size ){
+    state->begin    = buffer;
+    state->cur      = buffer;
+    state->line_pos = buffer;
+    state->end      = buffer+size;
 }
 
 /**
     Ensures that the character at the current stream position 
-    matches the character 'match'.  Prints an error and throws
-    an exception if the character does not match, otherwise
-    advances the character stream
+    matches the character 'match', and advances the character
+    stream if so. Otherwise reports an error (see xml_fail()).
  
     @param[in]  state   Current parser state
     @param[in]  match   Character to match
+    @return true if the character matched, false if the input ended
 */
-static inline void xml_match( xml_state *state, char match ){
-    char c = xml_peek( state );
-    if( c != match ){
-        xml_error( "xml_match(), expected %c, got %c at input line %d\n", match, c, state->line_number );
+static inline bool xml_match( xml_state *state, char match ){
+    if( *state->cur != match ){
+        const char expected[4] = { '\'', match, '\'', '\0' };
+        return xml_fail( state, state->cur, XML_ERROR_UNEXPECTED_CHAR, expected );
     }
     xml_advance( state );
+    return true;
 }
 
 /**
-    Advances the input until a non-whitespace character is found
+    Advances the input until a non-whitespace character is found,
+    see xml_skip_space()
     
     @param[in]  state Current parser state
 */
 static inline void xml_eat_space( xml_state *state ){
-    while( !xml_eof(state) && xml_is_space( xml_peek( state ) ) ){
-        xml_advance( state );
+    xml_advance_to( state, xml_skip_space( state->cur, state->end ) );
+}
+
+/**
+    Writes the UTF-8 encoding of the code point 'code' to 'out'
+ 
+    @param[in]  code    Code point, at most 0x10FFFF
+    @param[out] out     Receives 1 to 4 characters
+    @return number of characters written
+*/
+static inline size_t xml_encode_utf8( unsigned long code, char *out ){
+    if( code < 0x80 ){
+        out[0] = (char)code;
+        return 1;
+    }
+    if( code < 0x800 ){
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if( code < 0x10000 ){
+        out[0] = (char)(0xE0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
     }
+    out[0] = (char)(0xF0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
 }
 
 /**
-    Reads a quoted string from the input. Does not handle escape 
-    characters in any way
+    Decodes the reference starting at 'p', which points at a '&': one
+    of the predefined entities &amp;lt; &amp;gt; &amp;amp; &amp;quot;
+    &amp;apos; or a decimal (&amp;#60;) or hexadecimal (&amp;#x3C;)
+    character reference. The decoded text is never longer than the
+    reference, so 'out' may point at 'p'.
  
-    @param[in] state Current parser state
-    @return returns the string that was read, without quotes
+    @param[in]  p       Start of the reference
+    @param[in]  end     End of the text
+    @param[out] out     Receives the decoded characters
+    @param[out] written Number of characters written to 'out'
+    @return number of characters in the reference, or 0 if 'p' does
+            not start a well-formed reference
 */
-static inline std::string xml_parse_string( xml_state *state ){
-    std::string str;
-    
+static inline size_t xml_decode_reference( const char *p, const char *end, char *out, size_t *written ){
+    const size_t avail = end-p;
+    *written = 1;
+    if( avail >= 4 && (p[1] == 'l' || p[1] == 'g') && p[2] == 't' && p[3] == ';' ){
+        *out = p[1] == 'l' ? '<' : '>';
+        return 4;
+    }
+    if( avail >= 5 && memcmp( p, "&amp;", 5 ) == 0 ){
+        *out = '&';
+        return 5;
+    }
+    if( avail >= 6 && (memcmp( p, "&quot;", 6 ) == 0 || memcmp( p, "&apos;", 6 ) == 0) ){
+        *out = p[1] == 'q' ? '\"' : '\'';
+        return 6;
+    }
+    if( avail >= 4 && p[1] == '#' ){
+        const bool hex = p[2] == 'x';
+        const char *q = hex ? p+3 : p+2, *digits = q;
+        unsigned long code = 0;
+        for( ; q < end && code <= 0x10FFFF; q++ ){
+            if( xml_is_digit( *q ) )
+                code = code*(hex ? 16 : 10) + (*q-'0');
+            else if( hex && (*q|0x20) >= 'a' && (*q|0x20) <= 'f' )
+                code = code*16 + ((*q|0x20)-'a'+10);
+            else
+                break;
+        }
+        if( q == digits || q >= end || *q != ';' || code == 0 || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF) )
+            return 0;
+        *written = xml_encode_utf8( code, out );
+        return q+1-p;
+    }
+    return 0;
+}
+
+/**
+    Decodes the predefined entities and character references in 'raw'
+    into 'out', see xml_decode_reference(). Anything else following a
+    '&', such as a reference to an entity declared in a DTD, is copied
+    through unchanged. The result is never longer than 'raw', and
+    'out' may be raw.str to decode a writable buffer in place.
+ 
+    @param[in]  raw Text to decode
+    @param[out] out Receives the decoded text, at least raw.len characters
+    @return number of characters written to 'out'
+*/
+static inline size_t xml_decode_references( xml_span raw, char *out ){
+    const char *p = raw.str, *end = raw.str+raw.len;
+    char *o = out;
+    for(;;){
+        const char *amp = xml_find_char( p, end, '&' );
+        memmove( o, p, amp-p );
+        o += amp-p;
+        if( amp >= end )
+            break;
+        size_t written;
+        const size_t len = xml_decode_reference( amp, end, o, &written );
+        if( len == 0 ){
+            *o++ = '&';
+            p = amp+1;
+        } else {
+            o += written;
+            p = amp+len;
+        }
+    }
+    return o-out;
+}
+
+/**
+    Decodes the references in a value of the current token into
+    storage held by the parser state, see xml_decode_references().
+    Values are only passed here when the scan that found their end
+    also found a '&', so text without references is never copied. The
+    result remains valid until the next token is read.
+ 
+    @param[in]  state   Current parser state
+    @param[in]  raw     Value as it appears in the document
+    @return span over the decoded value
+*/
+static inline xml_span xml_decode_span( xml_state *state, xml_span raw ){
+    if( state->decoded_count == state->decoded.size() )
+        state->decoded.push_back( std::string() );
+    std::string &out = state->decoded[state->decoded_count++];
+    out.resize( raw.len );
+    out.resize( xml_decode_references( raw, &out[0] ) );
+    return xml_make_span( out.data(), out.size() );
+}
+
+/**
+    Reads a quoted string from the input, which may be delimited
+    by either double or single quotes. The closing quote is found
+    with a vectorized search (see xml_find_char_flag()) which also
+    notes whether the value contains a '&', and the value is returned
+    as a single span. References are not decoded here, see
+    xml_decode_span().
+ 
+    @param[in]  state      Current parser state
+    @param[out] str        Span over the string that was read, without quotes
+    @param[out] references Set to true if the string contains a '&', may be NULL
+    @return true if the string was read, false if the input ended
+*/
+static inline bool xml_parse_string( xml_state *state, xml_span *str, bool *references=NULL ){
     // gobble up whitespace
     xml_eat_space(state);
     
     // match the leading quote character
-    xml_match(state, '\"');
-    while( !xml_eof(state) && xml_peek(state) != '\"' ){        
-        // add the current character to the end of 
-        // the string being parsed
-        str.push_back( xml_peek( state ) );
-        xml_advance( state );
+    char quote = xml_peek( state );
+    if( quote != '\"' && quote != '\'' ){
+        return xml_fail( state, state->cur, XML_ERROR_UNEXPECTED_CHAR, "a quoted string" );
+    }
+    xml_advance( state );
+    
+    const char *start = state->cur;
+    bool found = false;
+    const char *p = xml_find_char_flag( start, state->end, quote, '&', &found );
+    if( p >= state->end ){
+        // report the error at the opening quote
+        return !state->final ? false : xml_set_error( state, start-1, XML_ERROR_UNTERMINATED_STRING, NULL );
     }
-    xml_match(state, '\"');
-    str.push_back('\0');
-    return str;
+    xml_advance_to( state, p+1 );
+    *str = xml_make_span( start, p-start );
+    if( references )
+        *references = found;
+    return true;
 }
 
 /**
     Reads an xml name (either a tag name or an attribute name)
     from the input. requires that the first non-whitespace
-    character encountered is a letter
+    character encountered is a name start character
  
     @param[in]  state Current parser state
-    @return name that was read
+    @param[out] name  Span over the name that was read
+    @return true if the name was read, false if the input ended
 */
-static inline std::string xml_read_name( xml_state *state ){
+static inline bool xml_read_name( xml_state *state, xml_span *name ){
     xml_eat_space(state);
-    if( !xml_is_alpha( xml_peek( state ) ) ){
-        xml_error( "xml_read_name(), expected an xml name, got '%c' at input line %d\n", xml_peek(state), state->line_number );
+    if( !xml_is_name_start_char( xml_peek( state ) ) ){
+        return xml_fail( state, state->cur, XML_ERROR_UNEXPECTED_CHAR, "an xml name" );
     }
-    std::string name;   
-    while( !xml_eof(state) && xml_is_valid_name_char( xml_peek( state ) ) ){
-        name.push_back( xml_peek(state) );
-        xml_advance(state);
+    const char *start = state->cur;
+    const char *p = start;
+    while( xml_is_valid_name_char( *p ) ){
+        p++;
     }
-    return name;
+    // the name may continue in input that has not arrived yet
+    if( p >= state->end && !state->final )
+        return false;
+    xml_advance_to( state, p );
+    *name = xml_make_span( start, p-start );
+    return true;
 }
 
 /**
     Reads the text field for a tag by advancing the input
-    until a '<' character is found. Returns the string
-    that was read.
+    until a '<' character is found. Returns the text
+    that was read. The search is vectorized (see xml_find_char_flag())
+    so long runs of text are consumed a block at a time, and notes
+    whether the text contains a '&' in the same pass.
  
-    @param[in] state    Current parser state
-    @return text string that was read
+    @param[in]  state      Current parser state
+    @param[out] text       Span over the text that was read
+    @param[out] references Set to true if the text contains a '&', may be NULL
+    @return true if the text was read, false if the input ended
 */
-static inline std::string xml_read_text( xml_state *state ){
-    std::string text;
-    while( !xml_eof(state) && xml_peek( state ) != '<' ){
-        text.push_back( xml_peek( state ) );
-        xml_advance(state);
+static inline bool xml_read_text( xml_state *state, xml_span *text, bool *references=NULL ){
+    const char *start = state->cur;
+    bool found = state->resume_references;
+    const char *p = xml_find_char_flag( start+state->resume, state->end, '<', '&', &found );
+    if( p >= state->end && !state->final ){
+        state->resume = p-start;
+        state->resume_references = found;
+        return false;
     }
-    return text;
+    xml_advance_to( state, p );
+    *text = xml_make_span( start, p-start );
+    if( references )
+        *references = found;
+    return true;
 }
 
 /**
@@ -263,230 +1071,1130 @@ static inline std::string xml_read_text( xml_state *state ){
     Returns the name that was read.
  
     @param[in]  state Current parser state
-    @return tag name that was read
+    @param[out] name  Span over the tag name that was read
+    @return true if the tag was read, false if the input ended
 */
-static inline std::string xml_read_closing_tag( xml_state *state ){
-    xml_match( state, '<' );
-    xml_match( state, '/' );
-    std::string name = xml_read_name( state );
-    xml_match( state, '>' );
-    return name;
+static inline bool xml_read_closing_tag( xml_state *state, xml_span *name ){
+    return xml_match( state, '<' ) && xml_match( state, '/' ) && xml_read_name( state, name ) 
+        && ( xml_eat_space( state ), xml_match( state, '>' ) );
 }
 
 /**
-    Read an xml comment tag.  Returns the comment text.
+    Read an xml comment tag.  Returns the comment text. The end of
+    the comment is located with a vectorized search for "--" (see
+    xml_find_seq()), which must then be followed by '>' since xml
+    does not allow "--" within a comment. The body is never copied,
+    so comments cost only the search when no callback wants them.
     
-    @param[in] state Current parser state
-    @return comment string that was read
+    @param[in]  state   Current parser state
+    @param[out] comment Span over the comment text that was read
+    @return true if the comment was read, false if the input ended
 */
-static inline std::string xml_read_comment( xml_state *state ){
-    std::string comment;
-    
+static inline bool xml_read_comment( xml_state *state, xml_span *comment ){
     // match the opening tag to the comment
-    xml_match( state, '<' );
-    xml_match( state, '!' );
-    xml_match( state, '-' );
-    xml_match( state, '-' );
-    
-    bool hyphen = false;
-    while( !xml_eof(state) ){
-        // current character is a hyphen, but the previous
-        // character was not a hyphen, set the hyphen flag
-        // and continue
-        if( xml_peek( state ) == '-' && !hyphen ){
-            xml_advance( state );
-            hyphen = true;
-            continue;
+    if( !xml_match( state, '<' ) || !xml_match( state, '!' ) || !xml_match( state, '-' ) || !xml_match( state, '-' ) )
+        return false;
+    
+    const char *start = state->cur;
+    const char *p = xml_find_seq( start+state->resume, state->end, "--", 2 );
+    if( p >= state->end ){
+        // a trailing hyphen may be the first of the pair
+        if( !state->final && state->end > start )
+            state->resume = state->end-start-1;
+        // report the error at the opening <!--
+        return !state->final ? false : xml_set_error( state, start-4, XML_ERROR_UNTERMINATED_COMMENT, NULL );
+    }
+    
+    // a pair of hyphens is only allowed to denote the end
+    // of the comment, advance past them and match the
+    // closing '>'
+    xml_advance_to( state, p+2 );
+    if( !xml_match( state, '>' ) )
+        return false;
+    *comment = xml_make_span( start, p-start );
+    return true;
+}
+
+/**
+    Reads a CDATA section, i.e. &lt;![CDATA[ ... ]]&gt;, and returns
+    its content. The end is located with a vectorized search for "]]>"
+    (see xml_find_seq()), and the content is returned as a single span
+    into the document without being examined or copied.
+ 
+    @param[in]  state Current parser state
+    @param[out] text  Span over the content of the section
+    @return true if the section was read, false if the input ended
+*/
+static inline bool xml_read_cdata( xml_state *state, xml_span *text ){
+    // match the opening <![CDATA[
+    const char *open = "<![CDATA[";
+    for( int i=0; i<9; i++ ){
+        if( !xml_match( state, open[i] ) )
+            return false;
+    }
+    
+    const char *start = state->cur;
+    const char *p = xml_find_seq( start+state->resume, state->end, "]]>", 3 );
+    if( p >= state->end ){
+        // the last two characters may start the terminator
+        if( !state->final && state->end-start > 2 )
+            state->resume = state->end-start-2;
+        // report the error at the opening <![CDATA[
+        return !state->final ? false : xml_set_error( state, start-9, XML_ERROR_UNTERMINATED_CDATA, NULL );
+    }
+    xml_advance_to( state, p+3 );
+    *text = xml_make_span( start, p-start );
+    return true;
+}
+
+/**
+    Finds the '>' which ends the tag whose name or attributes contain
+    'p', stepping over quoted values which may themselves contain '>'.
+    No other checking is done, see xml_skip_content().
+ 
+    @param[in]  p   Position within the tag
+    @param[in]  end End of the input
+    @return pointer to the closing '>', or 'end' if the tag is incomplete
+*/
+static inline const char *xml_find_tag_end( const char *p, const char *end ){
+    for( ; p < end; p++ ){
+        char c = *p;
+        if( c == '>' )
+            return p;
+        if( c == '\"' || c == '\'' ){
+            p = xml_find_char( p+1, end, c );
+            if( p >= end )
+                break;
         }
-        // current character is a hyphen and the previous
-        // character was also a hyphe, this is only allowed
-        // to denote the end of the comment, advance the
-        // input by a character and match the closing '<'
-        // and return
-        if( xml_peek( state ) == '-' && hyphen ){
-            xml_advance( state );
-            xml_match( state, '>' );
-            return comment;
+    }
+    return end;
+}
+
+/**
+    Fast-forwards over the content of skipped elements (see
+    xml_state::skip_depth) to the closing tag of the outermost one,
+    which is left to be read as a normal token. Nested tags are only
+    counted, not parsed, and no events are dispatched.
+ 
+    The scan runs in two stages over blocks of 64 characters: each
+    block is first classified into a mask of its markup delimiters
+    (see xml_markup_mask()), then only the set bits are visited, in
+    order, by a walk which tracks whether it is in text, a tag, a
+    quoted value or an end tag. Tags are therefore crossed without
+    testing every character. The content of comments, CDATA sections
+    and processing instructions is not markup, so they are passed
+    over with a search for their terminator instead. Only skipped
+    content is scanned this way; the tokens which are dispatched are
+    read by the usual one-pass code.
+ 
+    Progress is kept in the state, so when the input ends partway
+    through and more may follow, a later call continues from the
+    last complete piece.
+ 
+    @param[in]  state   Current parser state
+    @return true once the closing tag is reached, false if the input ended
+*/
+static inline bool xml_skip_content( xml_state *state ){
+    enum { SKIP_TEXT, SKIP_TAG, SKIP_QUOTE, SKIP_END_TAG };
+    const char *end = state->end;
+    const char *p   = state->cur;
+    const char *open = NULL;
+    int  within = SKIP_TEXT;
+    char quote  = 0;
+    while( p < end ){
+        // classify the next block, then visit its delimiters in order
+        const char *block = p;
+        uint64_t bits = xml_markup_mask( block, end );
+        p = end-block > 64 ? block+64 : end;
+        for( ; bits; bits &= bits-1 ){
+            const char *q = block + xml_ctz64( bits );
+            const char c = *q;
+            if( within == SKIP_TAG ){
+                // the tag ends at the first '>' outside a quoted value
+                if( c == '>' ){
+                    if( q[-1] != '/' )
+                        state->skip_depth++;
+                    within = SKIP_TEXT;
+                    open   = NULL;
+                } else if( c == '\"' || c == '\'' ){
+                    quote  = c;
+                    within = SKIP_QUOTE;
+                }
+            } else if( within == SKIP_QUOTE ){
+                if( c == quote )
+                    within = SKIP_TAG;
+            } else if( within == SKIP_END_TAG ){
+                if( c == '>' ){
+                    state->skip_depth--;
+                    within = SKIP_TEXT;
+                    open   = NULL;
+                }
+            } else if( c == '<' ){
+                // text up to the tag is consumed
+                open = q;
+                if( q+1 >= end )
+                    break;
+                if( q[1] == '/' ){
+                    if( state->skip_depth == 1 ){
+                        state->skip_depth = 0;
+                        state->cur = q;
+                        return true;
+                    }
+                    within = SKIP_END_TAG;
+                } else if( q[1] == '!' || q[1] == '?' ){
+                    // the content of comments etc. is not markup, search
+                    // for the terminator and continue after it
+                    const char *r;
+                    if( q[1] == '?' ){
+                        r = xml_find_seq( q+2, end, "?>", 2 );
+                        r = r < end ? r+1 : end;
+                    } else if( q[2] == '[' ){
+                        // CDATA content may contain '<' and '>'
+                        r = xml_find_seq( q+2, end, "]]>", 3 );
+                        r = r < end ? r+2 : end;
+                    } else if( q[2] == '-' && q[3] == '-' ){
+                        // as in xml_read_comment(), the first "--" ends the comment
+                        r = xml_find_seq( q+4, end, "--", 2 );
+                        r = r+2 < end ? r+2 : end;
+                        if( r < end && *r != '>' ){
+                            state->cur = q;
+                            return xml_set_error( state, r, XML_ERROR_UNEXPECTED_CHAR, "'>'" );
+                        }
+                    } else {
+                        r = xml_find_char( q, end, '>' );
+                    }
+                    if( r >= end ){
+                        p = end;
+                        break;
+                    }
+                    open = NULL;
+                    p = r+1;
+                    break;
+                } else {
+                    within = SKIP_TAG;
+                }
+            }
         }
-        
-        // current character is not a hyphen, append the
-        // character to the comment string and unset the 
-        // hyphen flag
-        comment.push_back( xml_peek( state ) );
-        xml_advance( state );
-        hyphen=false;
     }
-    // never reached?
-    return std::string("");
+    
+    // the input ended before the closing tag, a later call resumes
+    // at the start of the last incomplete piece
+    state->cur = open ? open : end;
+    if( !state->final )
+        return false;
+    char expected[64];
+    snprintf( expected, sizeof(expected), "</%s>", state->stack_names.c_str()+state->stack.back() );
+    return xml_set_error( state, end, XML_ERROR_UNCLOSED_TAG, expected );
 }
 
+/**
+    @brief Base class for handlers passed to the templated parser
+    entry points (xml_parse(), xml_read_document(state,handler)).
+    Events are dispatched by calling these member functions on the
+    handler's static type, so there is no indirect call per event and
+    the compiler is free to inline the handler into the scanner.
+    Derive from this class and define only the events of interest,
+    the remaining ones default to doing nothing.
+*/
+class xml_handler {
+public:
+    /** called whenever a new tag is started. A handler may instead
+        define begin_tag to return bool, in which case returning true
+        skips the attributes and all content of the tag: the parser
+        fast-forwards to the matching closing tag without dispatching
+        any events, then calls end_tag */
+    inline void begin_tag( xml_span name ){ (void)name; }
+    
+    /** called whenever a tag is ended */
+    inline void end_tag( xml_span name ){ (void)name; }
+    
+    /** called whenever the text for a tag is read */
+    inline void tag_text( xml_span text ){ (void)text; }
+    
+    /** called whenever a comment is read */
+    inline void comment( xml_span comment ){ (void)comment; }
+    
+    /** called whenever a CDATA section is read, with its content */
+    inline void cdata( xml_span text ){ (void)text; }
+    
+    /** called whenever a tag attribute is read */
+    inline void attribute( xml_span name, xml_span value ){ (void)name; (void)value; }
+    
+    /** called once per start tag with all of its attributes, after
+        begin_tag and before end_tag if the tag is self-closing, when
+        batch_attributes() returns true. 'attributes' points into a
+        buffer owned by the parser which is reused for the next tag. */
+    inline void attributes( xml_span name, const xml_attribute *attributes, size_t count ){ (void)name; (void)attributes; (void)count; }
+    
+    /** a handler which defines this to return true receives the
+        attributes of each start tag with a single call to attributes()
+        rather than a call to attribute() for each one. This is for
+        handlers which need the attributes together; collecting them
+        makes parsing slightly slower than per-attribute dispatch. */
+    inline bool batch_attributes(){ return false; }
+    
+    /** polled after each event, a handler which defines this to return
+        true stops the parser before the next event is dispatched, e.g.
+        once the data it is looking for has been found. The parse then
+        ends without error, and the position reached is recorded as an
+        XML_ERROR_STOPPED "error" (see xml_get_error()). */
+    inline bool stop_requested(){ return false; }
+    
+    /** a handler which defines this to return false receives text and
+        attribute values exactly as they appear in the document, rather
+        than with predefined entities and character references decoded
+        (see xml_decode_references()) */
+    inline bool decode_references(){ return true; }
+};
+
+/**
+    @brief Stand-in for the result of a begin_tag which returns void,
+    see xml_skip_requested()
+*/
+struct xml_no_skip {};
+
+/**
+    Yields the result of a begin_tag returning bool in the expression
+    ( handler.begin_tag( name ), xml_no_skip() ). When begin_tag returns
+    void the built-in comma operator applies instead and the expression
+    yields xml_no_skip, so handlers may use either return type.
+*/
+inline bool operator,( bool skip, xml_no_skip ){
+    return skip;
+}
+
+/**
+    Returns true if the result of begin_tag requests that the tag
+    be skipped, see xml_handler::begin_tag
+*/
+static inline bool xml_skip_requested( bool skip ){
+    return skip;
+}
+
+/** begin_tag returned void, the tag is never skipped */
+static inline bool xml_skip_requested( xml_no_skip ){
+    return false;
+}
+
+/**
+    @brief Handler which adapts the templated parser to the function
+    pointer interfaces, forwarding each event to the xml_span_callbacks
+    and/or xml_callbacks set in the parser state. Callbacks left NULL
+    are skipped, and no std::string is built for xml_callbacks events
+    that have no callback.
+*/
+class xml_callbacks_handler : public xml_handler {
+private:
+    /** callbacks receiving std::string events, may be NULL */
+    xml_callbacks       *m_callbacks;
+    
+    /** callbacks receiving span events, may be NULL */
+    xml_span_callbacks  *m_span_callbacks;
+public:
+    /**
+     Builds an adapter for the callbacks held in 'state'
+    */
+    xml_callbacks_handler( xml_state *state ){
+        m_callbacks = state->callbacks;
+        m_span_callbacks = state->span_callbacks;
+    }
+    
+    /** forwards begin_tag events, then asks skip_tag whether to skip the tag */
+    inline bool begin_tag( xml_span name ){
+        if( m_span_callbacks && m_span_callbacks->begin_tag )
+            m_span_callbacks->begin_tag( m_span_callbacks->user_data, name );
+        if( m_callbacks && m_callbacks->begin_tag ){
+            std::string str = xml_span_to_string( name );
+            m_callbacks->begin_tag( m_callbacks->user_data, str );
+        }
+        return m_span_callbacks && m_span_callbacks->skip_tag && m_span_callbacks->skip_tag( m_span_callbacks->user_data, name );
+    }
+    
+    /** forwards end_tag events */
+    inline void end_tag( xml_span name ){
+        if( m_span_callbacks && m_span_callbacks->end_tag )
+            m_span_callbacks->end_tag( m_span_callbacks->user_data, name );
+        if( m_callbacks && m_callbacks->end_tag ){
+            std::string str = xml_span_to_string( name );
+            m_callbacks->end_tag( m_callbacks->user_data, str );
+        }
+    }
+    
+    /** forwards tag_text events */
+    inline void tag_text( xml_span text ){
+        if( m_span_callbacks && m_span_callbacks->tag_text )
+            m_span_callbacks->tag_text( m_span_callbacks->user_data, text );
+        if( m_callbacks && m_callbacks->tag_text ){
+            std::string str = xml_span_to_string( text );
+            m_callbacks->tag_text( m_callbacks->user_data, str );
+        }
+    }
+    
+    /** forwards comment events */
+    inline void comment( xml_span comment ){
+        if( m_span_callbacks && m_span_callbacks->comment )
+            m_span_callbacks->comment( m_span_callbacks->user_data, comment );
+        if( m_callbacks && m_callbacks->comment ){
+            std::string str = xml_span_to_string( comment );
+            m_callbacks->comment( m_callbacks->user_data, str );
+        }
+    }
+    
+    /** forwards CDATA events */
+    inline void cdata( xml_span text ){
+        if( m_span_callbacks && m_span_callbacks->cdata )
+            m_span_callbacks->cdata( m_span_callbacks->user_data, text );
+        if( m_callbacks && m_callbacks->cdata ){
+            std::string str = xml_span_to_string( text );
+            m_callbacks->cdata( m_callbacks->user_data, str );
+        }
+    }
+    
+    /** forwards attribute events */
+    inline void attribute( xml_span name, xml_span value ){
+        if( m_span_callbacks && m_span_callbacks->attribute )
+            m_span_callbacks->attribute( m_span_callbacks->user_data, name, value );
+        if( m_callbacks && m_callbacks->attribute ){
+            std::string name_str  = xml_span_to_string( name );
+            std::string value_str = xml_span_to_string( value );
+            m_callbacks->attribute( m_callbacks->user_data, name_str, value_str );
+        }
+    }
+    
+    /** forwards the attributes of a tag to the span callback, and each
+        attribute to the std::string callback */
+    inline void attributes( xml_span name, const xml_attribute *attributes, size_t count ){
+        m_span_callbacks->attributes( m_span_callbacks->user_data, name, attributes, count );
+        if( m_callbacks && m_callbacks->attribute ){
+            for( size_t i=0; i<count; i++ ){
+                std::string name_str  = xml_span_to_string( attributes[i].name );
+                std::string value_str = xml_span_to_string( attributes[i].value );
+                m_callbacks->attribute( m_callbacks->user_data, name_str, value_str );
+            }
+        }
+    }
+    
+    /** batches attributes if the span callbacks take them all at once */
+    inline bool batch_attributes(){
+        return m_span_callbacks && m_span_callbacks->attributes;
+    }
+    
+    /** stops parsing once a callback has set the 'stop' flag */
+    inline bool stop_requested(){
+        return (m_span_callbacks && m_span_callbacks->stop) || (m_callbacks && m_callbacks->stop);
+    }
+};
+
 /**
     Matches the <?xml version="1.0" ... ?> header tag
  
     @param[in] state Current parser state
+    @return true if the header was read, false if the input ended
 */
-static inline void xml_read_header( xml_state *state ){
+static inline bool xml_read_header( xml_state *state ){
     // match the header for the xml 'tag'
-    xml_match(state, '<');
-    xml_match(state, '?');
-    xml_match(state, 'x');
-    xml_match(state, 'm');
-    xml_match(state, 'l');
+    if( !xml_match(state, '<') || !xml_match(state, '?') || !xml_match(state, 'x') || !xml_match(state, 'm') || !xml_match(state, 'l') )
+        return false;
     
     // read any attributes that occur
-    while( !xml_eof(state) ){
+    for(;;){
         // each up whitespace
         xml_eat_space( state );
         
-        // if the current character is alphabetic,
+        // if the current character can start a name,
         // then try to read an xml attribute
-        if( xml_is_alpha( xml_peek(state) ) ){
-            xml_read_name(state);
+        if( xml_is_name_start_char( xml_peek(state) ) ){
+            xml_span name = xml_make_span( NULL, 0 ), value = name;
+            if( !xml_read_name( state, &name ) )
+                return false;
             xml_eat_space(state);
-            xml_match(state,'=');
-            xml_parse_string(state);
+            if( !xml_match( state, '=' ) || !xml_parse_string( state, &value ) )
+                return false;
             continue;
         }
         
         // if the current character is a question match,
         // match the end of the header tag
-        if( xml_peek(state) == '?' && xml_peek(state,1) == '>' ){
-            xml_match(state, '?');
-            xml_match(state, '>');
-            xml_eat_space(state);
-            return;
+        if( xml_peek(state) == '?' ){
+            xml_advance( state );
+            return xml_match( state, '>' );
         }
+        
+        return xml_fail( state, state->cur, XML_ERROR_UNEXPECTED_CHAR, "an attribute or '?>'" );
     }
 }
 
 /**
-    Workhorse of the api, reads xml tags recursively, and 
-    calls the functions in the xml_callbacks structure to
-    allow the user's code to handle the data.
+    Reads the remainder of a start tag which the handler asked to skip,
+    without reading its attributes. If the tag is not self-closing the
+    parser then skips its content, see xml_skip_content().
  
-    @param[in]  state Current parser state
+    @param[in]  state    Current parser state
+    @param[in]  tag_name Name of the tag
+    @param[in]  handler  Handler receiving the parser events
+    @return true if the tag was read, false if the input ended
 */
-static inline void xml_read_tag( xml_state *state ){
-    std::string tag_name;
-    std::string tag_text;
-    std::string comment;
-    
-    // eat up all the leading whitespace
-    xml_eat_space(state);
-    
-    // match the leading < character
-    xml_match(state,'<');
+template< typename Handler >
+inline bool xml_skip_start_tag( xml_state *state, xml_span tag_name, Handler &handler ){
+    const char *p = xml_find_tag_end( state->cur, state->end );
+    if( p >= state->end )
+        return xml_fail( state, p, XML_ERROR_UNEXPECTED_CHAR, "'>'" );
+    xml_advance_to( state, p+1 );
     
-    // make sure the next character is a letter
-    tag_name = xml_read_name( state );
-    state->callbacks->begin_tag( state->callbacks->user_data, tag_name );
+    if( p[-1] == '/' ){
+        handler.end_tag( tag_name );
+        return true;
+    }
+    if( state->max_depth > 0 && (int)state->stack.size() >= state->max_depth ){
+        return xml_set_error( state, tag_name.str-1, XML_ERROR_DEPTH_EXCEEDED, NULL );
+    }
+    state->stack.push_back( state->stack_names.size() );
+    state->stack_names.append( tag_name.str, tag_name.len );
+    state->skip_depth = 1;
+    return true;
+}
+
+/**
+    Appends an attribute to the batch of the start tag being read,
+    see xml_handler::attributes()
+ 
+    @param[in]  state   Current parser state
+    @param[in]  count   Number of attributes already in the batch
+    @param[in]  name    Name of the attribute
+    @param[in]  value   Value of the attribute
+*/
+static inline void xml_push_attribute( xml_state *state, size_t count, xml_span name, xml_span value ){
+    if( count == state->attributes.size() )
+        state->attributes.resize( count ? 2*count : 16 );
+    xml_attribute &attribute = state->attributes[count];
+    attribute.name  = name;
+    attribute.value = value;
+}
+
+/**
+    Reads an opening tag including its attributes, i.e. either
+    &lt;name ...&gt; or the self-closing &lt;name ... /&gt;. The
+    former pushes the tag name onto the open-element stack.
+    Events are dispatched as the tag is read, except that attributes
+    are collected and dispatched together once the tag is closed if
+    the handler batches them.
+ 
+    @param[in]  state   Current parser state
+    @param[in]  handler Handler receiving the parser events
+    @return true if the tag was read, false if the input ended
+*/
+template< typename Handler >
+inline bool xml_read_start_tag( xml_state *state, Handler &handler ){
+    // match the leading < character, make sure the
+    // next character can start a name
+    xml_span tag_name = xml_make_span( NULL, 0 );
+    if( !xml_match( state, '<' ) || !xml_read_name( state, &tag_name ) )
+        return false;
+    bool skip = xml_skip_requested( ( handler.begin_tag( tag_name ), xml_no_skip() ) );
+    if( handler.stop_requested() )
+        return xml_set_stopped( state );
+    if( skip )
+        return xml_skip_start_tag( state, tag_name, handler );
     
     // read in the attributes
-    while( !xml_eof(state) ){
+    const bool batch = handler.batch_attributes();
+    const bool decode = handler.decode_references();
+    size_t count = 0;
+    for(;;){
         // eat
         xml_eat_space( state );
         
-        if( xml_is_alpha( xml_peek( state ) ) ){
+        if( xml_is_name_start_char( xml_peek( state ) ) ){
+            xml_span attrib_name = xml_make_span( NULL, 0 ), attrib_value = attrib_name;
+            
             // read the attribute name
-            std::string attrib_name = xml_read_name(state);
+            if( !xml_read_name( state, &attrib_name ) )
+                return false;
             
             // eat any whitespace that may have been added
             xml_eat_space(state);
             
-            // match the '=' character
-            xml_match(state, '=');
+            // match the '=' character and read the attribute value
+            bool references = false;
+            if( !xml_match( state, '=' ) || !xml_parse_string( state, &attrib_value, &references ) )
+                return false;
+            if( references && decode )
+                attrib_value = xml_decode_span( state, attrib_value );
             
-            // read the attribute value
-            std::string attrib_value = xml_parse_string(state);
-            
-            state->callbacks->attribute( state->callbacks->user_data, attrib_name, attrib_value );
+            // call the attribute callback, or add to the batch
+            if( batch ){
+                xml_push_attribute( state, count++, attrib_name, attrib_value );
+                continue;
+            }
+            handler.attribute( attrib_name, attrib_value );
+            if( handler.stop_requested() )
+                return xml_set_stopped( state );
             
             // go through the loop again
             continue;
         }
         
-        // if the opening tag is being closed, break from this loop
+        // if the opening tag is being closed, the tag
+        // remains open until its closing tag is read
         if( xml_peek(state) == '>' ){
-            xml_match( state, '>' );
-            break;
-        }
-        
-        // if the whole tag is being closed, break from this loop
-        if( xml_peek(state) == '/' && xml_peek(state,1) == '>' ){
-            xml_match( state, '/' );
-            xml_match( state, '>' );
-            state->callbacks->end_tag( state->callbacks->user_data, tag_name );
-            xml_eat_space(state);
-            return;
+            xml_advance( state );
+            if( batch ){
+                handler.attributes( tag_name, count ? &state->attributes[0] : NULL, count );
+                if( handler.stop_requested() )
+                    return xml_set_stopped( state );
+            }
+            if( state->max_depth > 0 && (int)state->stack.size() >= state->max_depth ){
+                return xml_set_error( state, tag_name.str-1, XML_ERROR_DEPTH_EXCEEDED, NULL );
+            }
+            state->stack.push_back( state->stack_names.size() );
+            state->stack_names.append( tag_name.str, tag_name.len );
+            return true;
         }
-    }
-    
-    while( !xml_eof(state) ){
-        // eat whitespace
-        xml_eat_space( state );
         
-        // try to read a closing tag
-        if( xml_peek(state) == '<' && xml_peek(state,1) == '/' ){
-            std::string close_name = xml_read_closing_tag( state );
-            if( close_name.compare( tag_name ) != 0 ){
-                xml_error( "xml_read_tag(), expected closing name (%s) to match tag name (%s) at input line %d\n", close_name.c_str(), tag_name.c_str(), state->line_number );
+        // if the whole tag is being closed, it is finished
+        if( xml_peek(state) == '/' ){
+            xml_advance( state );
+            if( !xml_match( state, '>' ) )
+                return false;
+            if( batch ){
+                handler.attributes( tag_name, count ? &state->attributes[0] : NULL, count );
+                if( handler.stop_requested() )
+                    return xml_set_stopped( state );
             }
-            state->callbacks->end_tag( state->callbacks->user_data, tag_name );
-            break;
+            handler.end_tag( tag_name );
+            return true;
         }
         
-        // try to read a comment
-        if( xml_peek(state) == '<' && xml_peek(state,1) == '!' ){
-            comment = xml_read_comment( state );
-            state->callbacks->comment( state->callbacks->user_data, comment );
-            continue;
+        return xml_fail( state, state->cur, XML_ERROR_UNEXPECTED_CHAR, "an attribute, '>' or '/>'" );
+    }
+}
+
+/**
+    Reads the closing tag of the innermost open element, checking that
+    the names match, and pops it from the open-element stack.
+ 
+    @param[in]  state   Current parser state
+    @param[in]  handler Handler receiving the parser events
+    @return true if the tag was read, false if the input ended
+*/
+template< typename Handler >
+inline bool xml_read_end_tag( xml_state *state, Handler &handler ){
+    xml_span close_name = xml_make_span( NULL, 0 );
+    if( !xml_read_closing_tag( state, &close_name ) )
+        return false;
+    
+    const size_t open_start = state->stack.back();
+    xml_span tag_name = xml_make_span( state->stack_names.data()+open_start, state->stack_names.size()-open_start );
+    if( !xml_span_equals( close_name, tag_name ) ){
+        char expected[64];
+        snprintf( expected, sizeof(expected), "</%.*s>", (int)tag_name.len, tag_name.str );
+        return xml_set_error( state, close_name.str, XML_ERROR_TAG_MISMATCH, expected );
+    }
+    state->stack.pop_back();
+    state->stack_names.resize( open_start );
+    handler.end_tag( close_name );
+    return true;
+}
+
+/**
+    Checks whether the start tag at the current position is complete
+    by reading it without dispatching any events, then returns to the
+    start of the tag. Malformed tags are reported as by
+    xml_read_start_tag().
+ 
+    @param[in]  state   Current parser state
+    @return true if the tag is complete, false if the input ended
+*/
+static inline bool xml_scan_start_tag( xml_state *state ){
+    const char   *token = state->cur;
+    const size_t depth  = state->stack.size();
+    const size_t decoded_count = state->decoded_count;
+    xml_handler  none;
+    if( !xml_read_start_tag( state, none ) )
+        return false;
+    state->decoded_count = decoded_count;
+    if( state->stack.size() > depth ){
+        state->stack_names.resize( state->stack.back() );
+        state->stack.pop_back();
+    }
+    state->cur = token;
+    return true;
+}
+
+/**
+    Workhorse of the api, reads the next token of the document (the
+    xml header, a start tag with its attributes, an end tag, a comment
+    or a run of text) and calls the member functions of 'handler' to
+    allow the user's code to handle the data. Nesting is tracked with
+    the explicit stack in xml_state rather than by recursion, so
+    arbitrarily deep documents (up to xml_state::max_depth) are parsed
+    in constant native stack space, and parsing can stop after any
+    token and resume later.
+ 
+    If the available input ends partway through a token and more input
+    may follow (xml_state::final is false), no events are dispatched,
+    the position is left at the start of the token and XML_INCOMPLETE
+    is returned. If the document is malformed the error is recorded in
+    the state (see xml_get_error()) and XML_ERROR is returned.
+ 
+    @param[in]  state   Current parser state
+    @param[in]  handler Handler receiving the parser events
+    @return XML_OK if a token was read, XML_INCOMPLETE if more input is
+            needed, XML_DONE at the end of the document, XML_STOPPED
+            if the handler asked to stop
+*/
+template< typename Handler >
+inline xml_status xml_read_token( xml_state *state, Handler &handler ){
+    // pass over the content of skipped elements
+    if( state->skip_depth ){
+        if( !xml_skip_content( state ) )
+            return xml_failure_status( state );
+    }
+    
+    // eat whitespace
+    xml_eat_space( state );
+    const char *token = state->cur;
+    
+    if( xml_eof(state) ){
+        if( !state->final )
+            return XML_INCOMPLETE;
+        if( !state->stack.empty() ){
+            char expected[64];
+            snprintf( expected, sizeof(expected), "</%s>", state->stack_names.c_str()+state->stack.back() );
+            xml_set_error( state, state->cur, XML_ERROR_UNCLOSED_TAG, expected );
+            return XML_ERROR;
         }
-        
-        // try to read a child tag
-        if( xml_peek(state) == '<' && xml_peek(state,1) != '/' ){
-            xml_read_tag( state );
-            continue;
+        return XML_DONE;
+    }
+    
+    bool complete;
+    if( xml_peek(state) == '<' ){
+        if( xml_peek(state,1) == '/' ){
+            // try to read a closing tag
+            complete = state->stack.empty() ? xml_set_error( state, state->cur, XML_ERROR_UNEXPECTED_CLOSE, NULL )
+                                            : xml_read_end_tag( state, handler );
+        } else if( xml_peek(state,1) == '!' && xml_peek(state,2) == '[' ){
+            // try to read a CDATA section, which is content of a tag
+            xml_span text = xml_make_span( NULL, 0 );
+            complete = state->stack.empty() ? xml_set_error( state, state->cur, XML_ERROR_UNEXPECTED_CHAR, "a tag or comment" )
+                                            : xml_read_cdata( state, &text );
+            if( complete )
+                handler.cdata( text );
+        } else if( xml_peek(state,1) == '!' ){
+            // try to read a comment
+            xml_span comment = xml_make_span( NULL, 0 );
+            complete = xml_read_comment( state, &comment );
+            if( complete )
+                handler.comment( comment );
+        } else if( xml_peek(state,1) == '?' ){
+            // read the xml-header information
+            complete = state->started ? xml_set_error( state, state->cur, XML_ERROR_MISPLACED_HEADER, NULL )
+                                      : xml_read_header( state );
+        } else {
+            // as the events of a start tag are dispatched while it is
+            // read, check that the tag is complete before reading it
+            // when it may be cut short by the end of the input
+            complete = state->final || xml_scan_start_tag( state );
+            
+            // try to read a child tag
+            if( complete )
+                complete = xml_read_start_tag( state, handler );
         }
-        
+    } else if( !state->stack.empty() ){
         // try to read the text of the tag (if applicable)
-        tag_text = xml_read_text( state );
-        state->callbacks->tag_text( state->callbacks->user_data, tag_text );
+        xml_span tag_text = xml_make_span( NULL, 0 );
+        bool references = false;
+        complete = xml_read_text( state, &tag_text, &references );
+        if( complete ){
+            if( references && handler.decode_references() )
+                tag_text = xml_decode_span( state, tag_text );
+            handler.tag_text( tag_text );
+        }
+    } else {
+        complete = xml_fail( state, state->cur, XML_ERROR_UNEXPECTED_CHAR, "'<'" );
+    }
+    
+    if( !complete ){
+        state->cur = token;
+        return xml_failure_status( state );
+    }
+    state->resume  = 0;
+    state->resume_references = false;
+    state->started = true;
+    
+    // the next token is only read once the events of this one have
+    // been handled, so its decoded values may reuse the storage
+    state->decoded_count = 0;
+    if( handler.stop_requested() ){
+        xml_set_stopped( state );
+        return XML_STOPPED;
     }
+    return XML_OK;
 }
 
 /**
  @brief reads an xml document by first trying to read the 
- xml header, followed by recursively reading any tags that
- occur
+ xml header, followed by reading any tags that occur. Errors are
+ stored in 'error' if given, otherwise they are reported on stderr
+ and thrown (see xml_raise_error()). Reading ends early if the
+ handler stops parsing, in which case 'error' receives the position
+ reached with code XML_ERROR_STOPPED.
  
- @param[in] state Current parser state
+ @param[in]  state   Current parser state
+ @param[in]  handler Handler receiving the parser events
+ @param[out] error   Receives the first error, or NULL to report errors
+ @return true if the document was read without error
  */
-static inline void xml_read_document( xml_state *state ){
-    // eat any whitespace that occurs
-    xml_eat_space( state );
-    
-    bool first = true;
-    while( !xml_eof(state) ){
-        if( xml_peek(state)=='<' ){
-            if( xml_peek(state,1)=='?' ){
-                if( !first ){
-                    xml_error("encountered a header tag midway through file");
-                }
-                // read the xml-header information
-                xml_read_header( state );
-            } else if( xml_peek(state,1)=='!'){
-                // found a comment tag
-                std::string comment = xml_read_comment( state );
-                state->callbacks->comment( state->callbacks->user_data, comment );
-            } else if( xml_is_alpha( xml_peek(state,1) ) ){
-                // alphabetic character, read a tag
-                xml_read_tag(state);
-            }
-            xml_eat_space(state);
-        } else {
-            xml_error("expected a < character\n");
+template< typename Handler >
+inline bool xml_read_document( xml_state *state, Handler &handler, xml_error_info *error=NULL ){
+    if( *state->end != '\0' ){
+        xml_set_error( state, state->end, XML_ERROR_NO_SENTINEL, NULL );
+    } else {
+        state->final = true;
+        while( xml_read_token( state, handler ) == XML_OK ){
         }
     }
+    return xml_report_status( state, error );
 }
 
+/**
+ @brief reads an xml document, delivering events to the xml_callbacks
+ and/or xml_span_callbacks set in 'state'
+ 
+ @param[in]  state Current parser state
+ @param[out] error Receives the first error, or NULL to report errors
+ @return true if the document was read without error
+ */
+static inline bool xml_read_document( xml_state *state, xml_error_info *error=NULL ){
+    xml_callbacks_handler handler( state );
+    return xml_read_document( state, handler, error );
+}
+
+/**
+ @brief parses the document held in a caller-owned buffer without
+ copying it, calling the member functions of 'handler' (see
+ xml_handler) for each event. As the handler type is known at
+ compile time its event handling can be inlined into the parser.
+ The handler may end the parse early, see xml_handler::stop_requested().
+ 
+ @param[in]  buffer  Pointer to the xml data, buffer[size] must be '\0'
+ @param[in]  size    Number of characters in buffer
+ @param[in]  handler Handler receiving the parser events
+ @param[out] error   Receives the first error, or NULL to report errors
+ @return true if the document was read without error
+ */
+template< typename Handler >
+inline bool xml_parse( const char *buffer, size_t size, Handler &handler, xml_error_info *error=NULL ){
+    xml_state state;
+    xml_init_state( &state, buffer, size, NULL, NULL );
+    return xml_read_document( &state, handler, error );
+}
+
+/**
+ @brief convenience wrapper which parses the document held in
+ a caller-owned buffer without copying it, delivering events
+ as spans into that buffer
+ 
+ @param[in]  buffer          Pointer to the xml data, buffer[size] must be '\0'
+ @param[in]  size            Number of characters in buffer
+ @param[in]  span_callbacks  Callbacks receiving the zero-copy events
+ @param[out] error           Receives the first error, or NULL to report errors
+ @return true if the document was read without error
+ */
+static inline bool xml_read_document( const char *buffer, size_t size, xml_span_callbacks *span_callbacks, xml_error_info *error=NULL ){
+    xml_state state;
+    xml_init_state( &state, buffer, size, NULL, span_callbacks );
+    return xml_read_document( &state, error );
+}
+
+/**
+ @brief reads the document held in 'buffer', delivering events to the
+ std::string callbacks. This replaces filling in the 'buffer', 'pos',
+ 'line_number' and 'column_number' members of an xml_state, which no
+ longer exist, i.e. code of the form
+
+     xml_state state = { buffer, 0, 0, 0, &callbacks };
+     xml_read_document( &state );
+
+ becomes xml_read_document( buffer, &callbacks ). The string is read
+ in place and must not be modified while parsing.
+
+ @param[in]  buffer    String holding the xml data
+ @param[in]  callbacks Callbacks receiving the events
+ @param[out] error     Receives the first error, or NULL to report errors
+ @return true if the document was read without error
+ */
+static inline bool xml_read_document( const std::string &buffer, xml_callbacks *callbacks, xml_error_info *error=NULL ){
+    xml_state state;
+    xml_init_state( &state, buffer.c_str(), buffer.size(), callbacks, NULL );
+    return xml_read_document( &state, error );
+}
+
+/**
+ @brief Incremental (push) parser which accepts the document in
+ chunks of any size, e.g. as it arrives from a pipe or socket, and
+ dispatches events to 'Handler' as soon as each token is complete.
+ 
+ Only the unconsumed tail of the input is retained between chunks:
+ when a chunk ends partway through a token, that token is moved to the
+ front of the buffer and completed by the following chunk, and scanning
+ of long text runs and comments resumes where it stopped rather than
+ starting again. The buffer is reused, so memory use is bounded by the
+ chunk size plus the largest token, which may be limited with
+ 'max_token'.
+ 
+ Input is provided either with feed(), or by writing it directly into
+ the buffer returned by input_buffer() and passing it to commit(),
+ which saves a copy when reading from a file or socket.
+ 
+ Spans passed to the handler point into the parser's internal buffer
+ and are only valid for the duration of the event. Errors are not
+ thrown: once one is found every call returns XML_ERROR, and the
+ error may be retrieved with error(). Likewise once the handler has
+ stopped parsing every call returns XML_STOPPED.
+*/
+template< typename Handler >
+class xml_push_parser {
+private:
+    /** parser state, positioned within m_buffer */
+    xml_state           m_state;
+    
+    /** handler receiving the parser events */
+    Handler             &m_handler;
+    
+    /** unconsumed input followed by space for the next chunk, grows
+        only when a chunk and the retained input do not fit */
+    std::vector<char>   m_buffer;
+    
+    /** maximum size of a token carried between chunks, zero for no limit */
+    size_t              m_max_token;
+    
+    /** reads all complete tokens in the buffer */
+    inline xml_status parse_available(){
+        if( m_state.error.code != XML_ERROR_NONE )
+            return xml_failure_status( &m_state );
+        xml_status status;
+        while( (status = xml_read_token( &m_state, m_handler )) == XML_OK ){
+        }
+        return status;
+    }
+public:
+    /**
+     Creates a parser dispatching events to 'handler'. Tokens longer
+     than 'max_token' characters (if non-zero) cause an error rather
+     than growing the buffer without bound.
+    */
+    xml_push_parser( Handler &handler, size_t max_token=0 ) : m_handler(handler), m_buffer( 1, '\0' ) {
+        m_max_token = max_token;
+        xml_init_state( &m_state, &m_buffer[0], 0, NULL, NULL );
+        m_state.final = false;
+    }
+    
+    /**
+     returns the parser state, e.g. to adjust max_depth or query
+     the position reached
+    */
+    inline xml_state *state(){
+        return &m_state;
+    }
+    
+    /**
+     Retrieves the error which stopped parsing, see xml_get_error()
+     
+     @return true if an error was found
+    */
+    inline bool error( xml_error_info *info ){
+        return xml_get_error( &m_state, info );
+    }
+    
+    /**
+     Returns space for up to 'size' characters of input, to be passed
+     to commit() once filled. The unconsumed input is first moved to
+     the start of the buffer, invalidating any spans into it.
+    */
+    inline char *input_buffer( size_t size ){
+        // drop the consumed input, keeping any incomplete token
+        xml_release_input( &m_state );
+        const size_t keep = m_state.end - m_state.cur;
+        memmove( &m_buffer[0], m_state.cur, keep );
+        if( keep+size+1 > m_buffer.size() ){
+            m_buffer.resize( keep+size+1 );
+        }
+        m_buffer[keep] = '\0';
+        xml_relocate_input( &m_state, &m_buffer[0], keep );
+        return &m_buffer[keep];
+    }
+    
+    /**
+     Parses the 'size' characters written to the space returned by the
+     last call to input_buffer(), dispatching events for every token
+     completed by them.
+     
+     @return XML_INCOMPLETE, as the document continues until finish(),
+             XML_ERROR or XML_STOPPED
+    */
+    inline xml_status commit( size_t size ){
+        const size_t total = (m_state.end - m_state.begin) + size;
+        m_buffer[total] = '\0';
+        xml_relocate_input( &m_state, &m_buffer[0], total );
+        
+        xml_status status = parse_available();
+        if( status == XML_INCOMPLETE && m_max_token && (size_t)(m_state.end-m_state.cur) > m_max_token ){
+            xml_set_error( &m_state, m_state.cur, XML_ERROR_TOKEN_TOO_LARGE, NULL );
+            return XML_ERROR;
+        }
+        return status;
+    }
+    
+    /**
+     Parses the next 'size' characters of the document, dispatching
+     events for every token completed by them.
+     
+     @return XML_INCOMPLETE, as the document continues until finish(),
+             XML_ERROR or XML_STOPPED
+    */
+    inline xml_status feed( const char *data, size_t size ){
+        memcpy( input_buffer( size ), data, size );
+        return commit( size );
+    }
+    
+    /**
+     Signals the end of the document and parses any remaining input,
+     which is an error if the document is incomplete.
+     
+     @return XML_DONE, XML_ERROR or XML_STOPPED
+    */
+    inline xml_status finish(){
+        m_state.final = true;
+        return parse_available();
+    }
+};
+
+/**
+ @brief Pull (cursor) parser which returns the events of a document
+ one at a time from next(), so that the consumer drives parsing from
+ its own loop rather than from callbacks, and may stop at any point.
+ 
+ The document is read from a caller-owned buffer without copying it,
+ one token at a time with the same scanner as xml_parse(); the events
+ of a token (e.g. a start tag and its attributes) are queued and
+ handed out in order. Spans in the events point into the buffer and
+ remain valid as long as it does, except that values in which
+ references were decoded are only valid until the event following the
+ last one of their token is requested. Errors are not thrown, instead
+ next() returns false and the error may be retrieved with error().
+*/
+class xml_pull_parser {
+private:
+    /**
+     Handler appending each event of a token to the queue. The queue
+     only grows, so that once it holds the largest token appending is
+     a plain store.
+    */
+    class event_queue : public xml_handler {
+    public:
+        /** queued events, valid up to 'count' */
+        std::vector<xml_event> events;
+        
+        /** number of queued events */
+        size_t count;
+        
+        event_queue() : events( 16 ), count( 0 ) {}
+        
+        inline void push( xml_event_type type, xml_span name, xml_span value ){
+            if( count == events.size() )
+                events.resize( 2*count );
+            xml_event &event = events[count++];
+            event.type  = type;
+            event.name  = name;
+            event.value = value;
+        }
+        inline void begin_tag( xml_span name ){ push( XML_EVENT_BEGIN_TAG, name, xml_make_span( name.str, 0 ) ); }
+        inline void end_tag( xml_span name ){ push( XML_EVENT_END_TAG, name, xml_make_span( name.str, 0 ) ); }
+        inline void tag_text( xml_span text ){ push( XML_EVENT_TAG_TEXT, xml_make_span( text.str, 0 ), text ); }
+        inline void comment( xml_span comment ){ push( XML_EVENT_COMMENT, xml_make_span( comment.str, 0 ), comment ); }
+        inline void cdata( xml_span text ){ push( XML_EVENT_CDATA, xml_make_span( text.str, 0 ), text ); }
+        inline void attribute( xml_span name, xml_span value ){ push( XML_EVENT_ATTRIBUTE, name, value ); }
+    };
+    
+    /** parser state, positioned after the last token read */
+    xml_state       m_state;
+    
+    /** events of the last token read */
+    event_queue     m_queue;
+    
+    /** index of the next event in m_queue to return */
+    size_t          m_next;
+public:
+    /**
+     Creates a parser over 'size' characters at 'buffer', which must
+     be followed by a '\0' sentinel, i.e. buffer[size] == '\0'
+    */
+    xml_pull_parser( const char *buffer, size_t size ){
+        xml_init_state( &m_state, buffer, size, NULL, NULL );
+        if( *m_state.end != '\0' ){
+            xml_set_error( &m_state, m_state.end, XML_ERROR_NO_SENTINEL, NULL );
+        }
+        m_next = 0;
+    }
+    
+    /**
+     returns the parser state, e.g. to adjust max_depth or query
+     the position reached
+    */
+    inline xml_state *state(){
+        return &m_state;
+    }
+    
+    /**
+     Retrieves the error which stopped parsing, see xml_get_error()
+     
+     @return true if an error was found
+    */
+    inline bool error( xml_error_info *info ){
+        return xml_get_error( &m_state, info );
+    }
+    
+    /**
+     Reads the next event of the document into 'event'.
+     
+     @return true if an event was read, false at the end of the document
+             or if an error was found, see error()
+    */
+    inline bool next( xml_event *event ){
+        while( m_next == m_queue.count ){
+            if( m_state.error.code != XML_ERROR_NONE )
+                return false;
+            m_queue.count = 0;
+            m_next = 0;
+            // events read before an error are still returned, as
+            // they would have been dispatched to a handler
+            if( xml_read_token( &m_state, m_queue ) != XML_OK && m_queue.count == 0 )
+                return false;
+        }
+        *event = m_queue.events[m_next++];
+        return true;
+    }
+    
+    /**
+     Skips the content of the element whose XML_EVENT_BEGIN_TAG was
+     just returned by next(), including its remaining attributes,
+     without reading it; see xml_skip_content(). The next event is
+     then the XML_EVENT_END_TAG of the element.
+     
+     @return true if the element is skipped, false if the last event
+             returned was not a begin tag
+    */
+    inline bool skip(){
+        if( m_next == 0 || m_queue.events[m_next-1].type != XML_EVENT_BEGIN_TAG )
+            return false;
+        while( m_next < m_queue.count && m_queue.events[m_next].type == XML_EVENT_ATTRIBUTE )
+            m_next++;
+        // a self-closing tag has its end tag queued already
+        if( m_next == m_queue.count && m_state.error.code == XML_ERROR_NONE )
+            m_state.skip_depth = 1;
+        return true;
+    }
+};
+
 #endif
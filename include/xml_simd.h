@@ -0,0 +1,488 @@
+#ifndef XML_SIMD_H
+#define XML_SIMD_H
+
+/**
+ @file xml_simd.h
+ Character classification and vectorized character-search kernels
+ used by the scanners in xml_parse.h. SSE2 is used as the baseline on x86, with AVX2 when
+ the compiler targets it (e.g. -mavx2 or -march=native). SSSE3 is
+ detected for kernels which need byte shuffles (see xml_base64.h). Defining
+ XML_NO_SIMD before including the parser selects the portable
+ scalar versions.
+
+ All kernels operate on a half-open range [p,end) and never read
+ at or beyond 'end'; blocks are only loaded while a full vector of
+ input remains and the tail is handled one byte at a time.
+
+ @author James Gregson
+ */
+
+#include<cstddef>
+#include<cstring>
+#include<stdint.h>
+
+#if !defined(XML_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define XML_SIMD_SSE2
+#include<emmintrin.h>
+#endif
+
+#if !defined(XML_NO_SIMD) && defined(__SSSE3__)
+#define XML_SIMD_SSSE3
+#include<tmmintrin.h>
+#endif
+
+#if !defined(XML_NO_SIMD) && defined(__AVX2__)
+#define XML_SIMD_AVX2
+#include<immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include<intrin.h>
+#endif
+
+/**
+    64-bit unsigned constant. The ULL suffix is only standard from
+    C++11, so the <stdint.h> macro is used where available, which
+    keeps the headers free of warnings under -std=c++98 -pedantic.
+*/
+#if defined(UINT64_C)
+#define XML_U64( c ) UINT64_C( c )
+#else
+#define XML_U64( c ) c##ULL
+#endif
+
+/**
+    Returns the index of the lowest set bit of a non-zero mask
+
+    @param[in]  mask    Non-zero bit mask
+    @return index of the lowest set bit
+*/
+static inline int xml_ctz( unsigned int mask ){
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward( &index, mask );
+    return (int)index;
+#else
+    return __builtin_ctz( mask );
+#endif
+}
+
+/**
+    Returns the index of the lowest set bit of a non-zero 64-bit mask
+
+    @param[in]  mask    Non-zero bit mask
+    @return index of the lowest set bit
+*/
+static inline int xml_ctz64( uint64_t mask ){
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64( &index, mask );
+    return (int)index;
+#elif defined(_MSC_VER)
+    return (uint32_t)mask ? xml_ctz( (uint32_t)mask ) : 32 + xml_ctz( (uint32_t)(mask >> 32) );
+#else
+    return __builtin_ctzll( mask );
+#endif
+}
+
+/**
+    @brief bit flags stored in xml_char_class_table for each byte value
+*/
+enum {
+    /** xml whitespace: space, tab, carriage return, newline */
+    XML_CHAR_SPACE      = 1,
+    /** ascii letter */
+    XML_CHAR_ALPHA      = 2,
+    /** ascii digit */
+    XML_CHAR_DIGIT      = 4,
+    /** may start a name: letters, '_', ':' and any byte of a multi-byte UTF-8 sequence */
+    XML_CHAR_NAME_START = 8,
+    /** may continue a name: name start characters plus digits, '-' and '.' */
+    XML_CHAR_NAME       = 16
+};
+
+/**
+    Classification of every byte value as a combination of the
+    XML_CHAR_* flags. Unlike the <ctype.h> functions this does not
+    depend on the current locale and is well defined for bytes with
+    the high bit set, which are treated as name characters so that
+    UTF-8 names pass through intact.
+*/
+static const unsigned char xml_char_class_table[256] = {
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, // 0x00-0x0F
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x10-0x1F
+     1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,16,16, 0, // 0x20-0x2F
+    20,20,20,20,20,20,20,20,20,20,24, 0, 0, 0, 0, 0, // 0x30-0x3F
+     0,26,26,26,26,26,26,26,26,26,26,26,26,26,26,26, // 0x40-0x4F
+    26,26,26,26,26,26,26,26,26,26,26, 0, 0, 0, 0,24, // 0x50-0x5F
+     0,26,26,26,26,26,26,26,26,26,26,26,26,26,26,26, // 0x60-0x6F
+    26,26,26,26,26,26,26,26,26,26,26, 0, 0, 0, 0, 0, // 0x70-0x7F
+    24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24, // 0x80-0x8F
+    24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24, // 0x90-0x9F
+    24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24, // 0xA0-0xAF
+    24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24, // 0xB0-0xBF
+    24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24, // 0xC0-0xCF
+    24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24, // 0xD0-0xDF
+    24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24, // 0xE0-0xEF
+    24,24,24,24,24,24,24,24,24,24,24,24,24,24,24,24, // 0xF0-0xFF
+};
+
+/**
+    Returns the XML_CHAR_* flags of character 'c'
+
+    @param[in]  c   Input character
+    @return bitwise or of the XML_CHAR_* flags that apply to c
+*/
+static inline unsigned char xml_char_class( char c ){
+    return xml_char_class_table[(unsigned char)c];
+}
+
+/**
+    Returns true if 'c' is xml whitespace, i.e. one of space, tab,
+    carriage return or newline
+
+    @param[in]  c   Input character to be tested
+    @return true if c is an xml whitespace character
+*/
+static inline bool xml_simd_is_space( char c ){
+    return ( xml_char_class( c ) & XML_CHAR_SPACE ) != 0;
+}
+
+/**
+    Finds the first occurrence of character 'c' in [p,end)
+
+    @param[in]  p   Start of the range to search
+    @param[in]  end End of the range to search
+    @param[in]  c   Character to search for
+    @return pointer to the first occurrence of 'c', or 'end' if not found
+*/
+static inline const char *xml_find_char( const char *p, const char *end, char c ){
+#if defined(XML_SIMD_AVX2)
+    const __m256i needle32 = _mm256_set1_epi8( c );
+    while( end-p >= 32 ){
+        __m256i block = _mm256_loadu_si256( (const __m256i*)p );
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8( _mm256_cmpeq_epi8( block, needle32 ) );
+        if( mask )
+            return p + xml_ctz( mask );
+        p += 32;
+    }
+#endif
+#if defined(XML_SIMD_SSE2)
+    const __m128i needle16 = _mm_set1_epi8( c );
+    while( end-p >= 16 ){
+        __m128i block = _mm_loadu_si128( (const __m128i*)p );
+        unsigned int mask = (unsigned int)_mm_movemask_epi8( _mm_cmpeq_epi8( block, needle16 ) );
+        if( mask )
+            return p + xml_ctz( mask );
+        p += 16;
+    }
+#endif
+    while( p < end && *p != c ){
+        p++;
+    }
+    return p;
+}
+
+/**
+    Finds the first occurrence of character 'c' in [p,end) as
+    xml_find_char() does, and in the same pass notes whether character
+    'flag' occurs before it, e.g. whether a run of text contains a
+    reference that needs decoding. Blocks are searched for either
+    character, so the common case where 'flag' is absent costs one
+    extra compare per block; once 'flag' is found the remainder is
+    searched with xml_find_char(). 'found' is only ever set, so that a
+    search resumed in pieces accumulates the result.
+
+    @param[in]  p       Start of the range to search
+    @param[in]  end     End of the range to search
+    @param[in]  c       Character to search for
+    @param[in]  flag    Character to look out for
+    @param[out] found   Set to true if 'flag' occurs before the result
+    @return pointer to the first occurrence of 'c', or 'end' if not found
+*/
+static inline const char *xml_find_char_flag( const char *p, const char *end, char c, char flag, bool *found ){
+#if defined(XML_SIMD_AVX2)
+    const __m256i needle32 = _mm256_set1_epi8( c );
+    const __m256i flag32   = _mm256_set1_epi8( flag );
+    while( end-p >= 32 ){
+        __m256i block = _mm256_loadu_si256( (const __m256i*)p );
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8( _mm256_or_si256( _mm256_cmpeq_epi8( block, needle32 ), _mm256_cmpeq_epi8( block, flag32 ) ) );
+        if( mask ){
+            p += xml_ctz( mask );
+            if( *p == c )
+                return p;
+            *found = true;
+            return xml_find_char( p+1, end, c );
+        }
+        p += 32;
+    }
+#endif
+#if defined(XML_SIMD_SSE2)
+    const __m128i needle16 = _mm_set1_epi8( c );
+    const __m128i flag16   = _mm_set1_epi8( flag );
+    while( end-p >= 16 ){
+        __m128i block = _mm_loadu_si128( (const __m128i*)p );
+        unsigned int mask = (unsigned int)_mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( block, needle16 ), _mm_cmpeq_epi8( block, flag16 ) ) );
+        if( mask ){
+            p += xml_ctz( mask );
+            if( *p == c )
+                return p;
+            *found = true;
+            return xml_find_char( p+1, end, c );
+        }
+        p += 16;
+    }
+#endif
+    for( ; p < end && *p != c; p++ ){
+        if( *p == flag ){
+            *found = true;
+            return xml_find_char( p+1, end, c );
+        }
+    }
+    return p;
+}
+
+/**
+    Finds the first occurrence of the character sequence 'seq' of
+    length 'len' in [p,end), in the manner of memmem(). Blocks are
+    filtered by comparing the first and last characters of 'seq'
+    at their respective offsets, and only candidate positions that
+    pass both are verified with memcmp().
+
+    @param[in]  p   Start of the range to search
+    @param[in]  end End of the range to search
+    @param[in]  seq Character sequence to search for
+    @param[in]  len Number of characters in seq, at least 1
+    @return pointer to the first occurrence of seq, or 'end' if not found
+*/
+static inline const char *xml_find_seq( const char *p, const char *end, const char *seq, size_t len ){
+#if defined(XML_SIMD_AVX2)
+    const __m256i first32 = _mm256_set1_epi8( seq[0] );
+    const __m256i last32  = _mm256_set1_epi8( seq[len-1] );
+    while( end-p >= (ptrdiff_t)(32+len-1) ){
+        __m256i block_first = _mm256_loadu_si256( (const __m256i*)p );
+        __m256i block_last  = _mm256_loadu_si256( (const __m256i*)(p+len-1) );
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8( _mm256_and_si256( _mm256_cmpeq_epi8( block_first, first32 ), _mm256_cmpeq_epi8( block_last, last32 ) ) );
+        while( mask ){
+            const char *candidate = p + xml_ctz( mask );
+            if( memcmp( candidate, seq, len ) == 0 )
+                return candidate;
+            mask &= mask-1;
+        }
+        p += 32;
+    }
+#endif
+#if defined(XML_SIMD_SSE2)
+    const __m128i first16 = _mm_set1_epi8( seq[0] );
+    const __m128i last16  = _mm_set1_epi8( seq[len-1] );
+    while( end-p >= (ptrdiff_t)(16+len-1) ){
+        __m128i block_first = _mm_loadu_si128( (const __m128i*)p );
+        __m128i block_last  = _mm_loadu_si128( (const __m128i*)(p+len-1) );
+        unsigned int mask = (unsigned int)_mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi8( block_first, first16 ), _mm_cmpeq_epi8( block_last, last16 ) ) );
+        while( mask ){
+            const char *candidate = p + xml_ctz( mask );
+            if( memcmp( candidate, seq, len ) == 0 )
+                return candidate;
+            mask &= mask-1;
+        }
+        p += 16;
+    }
+#endif
+    while( end-p >= (ptrdiff_t)len ){
+        if( *p == seq[0] && memcmp( p, seq, len ) == 0 )
+            return p;
+        p++;
+    }
+    return end;
+}
+
+/**
+    Skips a run of xml whitespace (space, tab, carriage return,
+    newline) starting at p, which must point at a whitespace
+    character. Indentation of the form newline followed by a run of
+    tabs or spaces is consumed eight bytes at a time with a word
+    compare, and long runs are skipped a vector at a time.
+
+    @param[in]  p   Start of the run, *p must be whitespace
+    @param[in]  end End of the range
+    @return pointer to the first non-whitespace character, or 'end'
+*/
+static inline const char *xml_skip_space_run( const char *p, const char *end ){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // newline (or CRLF) followed by an indentation run of a single
+    // character: xor against the repeated indent character, the
+    // lowest non-zero byte marks the end of the run
+    if( *p == '\r' && end-p >= 2 && p[1] == '\n' )
+        p++;
+    if( *p == '\n' && end-p >= 2 && (p[1] == '\t' || p[1] == ' ') ){
+        const uint64_t repeat = (uint64_t)(unsigned char)p[1] * XML_U64( 0x0101010101010101 );
+        p++;
+        while( end-p >= 8 ){
+            uint64_t word;
+            memcpy( &word, p, 8 );
+            uint64_t diff = word ^ repeat;
+            if( diff ){
+                p += xml_ctz64( diff ) >> 3;
+                if( !xml_simd_is_space( *p ) )
+                    return p;
+                break;
+            }
+            p += 8;
+        }
+    }
+#endif
+
+    // short runs, such as single separating spaces, do not justify
+    // the setup of the vector loop
+    const char *scalar_end = end-p > 16 ? p+16 : end;
+    while( p < scalar_end && xml_simd_is_space( *p ) ){
+        p++;
+    }
+    if( p < scalar_end || p == end )
+        return p;
+
+#if defined(XML_SIMD_AVX2)
+    const __m256i space32 = _mm256_set1_epi8( ' ' );
+    const __m256i tab32   = _mm256_set1_epi8( '\t' );
+    const __m256i nl32    = _mm256_set1_epi8( '\n' );
+    const __m256i cr32    = _mm256_set1_epi8( '\r' );
+    while( end-p >= 32 ){
+        __m256i block = _mm256_loadu_si256( (const __m256i*)p );
+        __m256i ws = _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( block, space32 ), _mm256_cmpeq_epi8( block, tab32 ) ),
+                                      _mm256_or_si256( _mm256_cmpeq_epi8( block, nl32 ),    _mm256_cmpeq_epi8( block, cr32 ) ) );
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8( ws );
+        if( mask )
+            return p + xml_ctz( mask );
+        p += 32;
+    }
+#endif
+#if defined(XML_SIMD_SSE2)
+    const __m128i space16 = _mm_set1_epi8( ' ' );
+    const __m128i tab16   = _mm_set1_epi8( '\t' );
+    const __m128i nl16    = _mm_set1_epi8( '\n' );
+    const __m128i cr16    = _mm_set1_epi8( '\r' );
+    while( end-p >= 16 ){
+        __m128i block = _mm_loadu_si128( (const __m128i*)p );
+        __m128i ws = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( block, space16 ), _mm_cmpeq_epi8( block, tab16 ) ),
+                                   _mm_or_si128( _mm_cmpeq_epi8( block, nl16 ),    _mm_cmpeq_epi8( block, cr16 ) ) );
+        unsigned int mask = ~(unsigned int)_mm_movemask_epi8( ws ) & 0xFFFF;
+        if( mask )
+            return p + xml_ctz( mask );
+        p += 16;
+    }
+#endif
+    while( p < end && xml_simd_is_space( *p ) ){
+        p++;
+    }
+    return p;
+}
+
+/**
+    Returns a mask of the markup delimiters '<', '>', '"' and '\'' among
+    the 64 characters starting at p, bit i being set if p[i] is one of
+    them. This is the first stage of scans which only need to visit
+    delimiters, e.g. xml_skip_content(): a block is classified with a
+    few vector compares, after which each delimiter is found with a
+    count of trailing zeros rather than by testing every character.
+    Characters at or beyond 'end' are never read and contribute no bits.
+
+    @param[in]  p   Start of the block
+    @param[in]  end End of the range
+    @return mask of the delimiters in [p,min(p+64,end))
+*/
+static inline uint64_t xml_markup_mask( const char *p, const char *end ){
+    char tail[64];
+    if( end-p < 64 ){
+        // classify a zero-padded copy of the last partial block
+        memset( tail, 0, sizeof(tail) );
+        memcpy( tail, p, end-p );
+        p = tail;
+    }
+    uint64_t mask = 0;
+#if defined(XML_SIMD_AVX2)
+    for( int i=0; i<64; i += 32 ){
+        __m256i block = _mm256_loadu_si256( (const __m256i*)(p+i) );
+        __m256i delim = _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( block, _mm256_set1_epi8( '<' ) ),  _mm256_cmpeq_epi8( block, _mm256_set1_epi8( '>' ) ) ),
+                                         _mm256_or_si256( _mm256_cmpeq_epi8( block, _mm256_set1_epi8( '\"' ) ), _mm256_cmpeq_epi8( block, _mm256_set1_epi8( '\'' ) ) ) );
+        mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8( delim ) << i;
+    }
+#elif defined(XML_SIMD_SSE2)
+    for( int i=0; i<64; i += 16 ){
+        __m128i block = _mm_loadu_si128( (const __m128i*)(p+i) );
+        __m128i delim = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( '<' ) ),  _mm_cmpeq_epi8( block, _mm_set1_epi8( '>' ) ) ),
+                                      _mm_or_si128( _mm_cmpeq_epi8( block, _mm_set1_epi8( '\"' ) ), _mm_cmpeq_epi8( block, _mm_set1_epi8( '\'' ) ) ) );
+        mask |= (uint64_t)(unsigned int)_mm_movemask_epi8( delim ) << i;
+    }
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // eight bytes at a time: a byte of 'word ^ repeat' is zero where it
+    // matches, the high bit of every zero byte is isolated without
+    // borrows between bytes and the eight flags are gathered into the
+    // top byte by a multiply
+    const uint64_t low7 = XML_U64( 0x7F7F7F7F7F7F7F7F );
+    const uint64_t match[4] = { '<' * XML_U64( 0x0101010101010101 ), '>' * XML_U64( 0x0101010101010101 ),
+                                '\"' * XML_U64( 0x0101010101010101 ), '\'' * XML_U64( 0x0101010101010101 ) };
+    for( int i=0; i<64; i += 8 ){
+        uint64_t word;
+        memcpy( &word, p+i, 8 );
+        uint64_t found = 0;
+        for( int k=0; k<4; k++ ){
+            const uint64_t diff = word ^ match[k];
+            found |= ~(((diff & low7) + low7) | diff | low7);
+        }
+        mask |= (((found >> 7) * XML_U64( 0x0102040810204080 )) >> 56) << i;
+    }
+#else
+    for( int i=0; i<64; i++ ){
+        const char c = p[i];
+        mask |= (uint64_t)(c == '<' || c == '>' || c == '\"' || c == '\'') << i;
+    }
+#endif
+    return mask;
+}
+
+/**
+    Returns the length of the run of ascii digits starting at p. Runs
+    are expected to be short (the digits of a single number), so a
+    single 16 byte block is classified before falling back to a
+    byte-at-a-time loop for the remainder.
+
+    @param[in]  p   Start of the run
+    @param[in]  end End of the range
+    @return number of consecutive digits at p, possibly zero
+*/
+static inline size_t xml_digit_run( const char *p, const char *end ){
+    const char *start = p;
+#if defined(XML_SIMD_SSE2)
+    if( end-p >= 16 ){
+        __m128i block = _mm_loadu_si128( (const __m128i*)p );
+        __m128i digits = _mm_and_si128( _mm_cmpgt_epi8( block, _mm_set1_epi8( '0'-1 ) ),
+                                        _mm_cmplt_epi8( block, _mm_set1_epi8( '9'+1 ) ) );
+        unsigned int mask = ~(unsigned int)_mm_movemask_epi8( digits ) & 0xFFFF;
+        if( mask )
+            return xml_ctz( mask );
+        p += 16;
+    }
+#endif
+    while( p < end && (xml_char_class( *p ) & XML_CHAR_DIGIT) ){
+        p++;
+    }
+    return p-start;
+}
+
+/**
+    Skips xml whitespace in [p,end). Most calls are made where no
+    whitespace is present, so that check is kept small enough to be
+    inlined into the scanners and runs are handed to
+    xml_skip_space_run().
+
+    @param[in]  p   Start of the range to skip
+    @param[in]  end End of the range
+    @return pointer to the first non-whitespace character, or 'end'
+*/
+static inline const char *xml_skip_space( const char *p, const char *end ){
+    if( p >= end || !xml_simd_is_space( *p ) )
+        return p;
+    return xml_skip_space_run( p, end );
+}
+
+#endif
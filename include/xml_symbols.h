@@ -0,0 +1,398 @@
+#ifndef XML_SYMBOLS_H
+#define XML_SYMBOLS_H
+
+/**
+ @file xml_symbols.h
+ Symbol tables mapping the tag and attribute names an application
+ knows about to small integer ids, so that events can be dispatched
+ with a switch rather than by comparing strings.
+
+ The vocabulary is registered once with xml_init_symbols(), which
+ builds a perfect hash by hash-and-displace: names are grouped into
+ buckets by one hash, and each bucket is given a displacement which
+ sends all of its names to otherwise unused slots under a second
+ hash. Both hashes are a single multiplication and shift of a key
+ packing the length and the first and last characters of the name,
+ so a lookup costs two multiplications, two table loads and at most
+ one memcmp() whatever the size of the vocabulary, and names of up
+ to two characters need no string comparison at all. Names outside
+ the vocabulary are reported as XML_SYMBOL_UNKNOWN. Wrapping a
+ handler in an xml_symbol_adapter (or calling xml_parse_symbols())
+ passes the id of each name to the handler alongside its span.
+
+ @author James Gregson
+ */
+
+#include<cstring>
+#include<string>
+#include<vector>
+#include<algorithm>
+#include<stdint.h>
+
+#include"xml_parse.h"
+
+/** id reported for names which are not in the symbol table */
+#define XML_SYMBOL_UNKNOWN (-1)
+
+/**
+    @brief Slot of an xml_symbols table
+*/
+typedef struct {
+    /** key of the name in the slot, see xml_symbol_key() */
+    uint32_t                    key;
+
+    /** length of the name in the slot, ~0 if the slot is empty */
+    uint32_t                    len;
+
+    /** id of the name in the slot, XML_SYMBOL_UNKNOWN if empty */
+    int                         id;
+} xml_symbol_entry;
+
+/**
+    @brief Perfect hash table of names, see xml_init_symbols()
+*/
+typedef struct {
+    /** registered names, indexed by id */
+    std::vector<std::string>        names;
+
+    /** table in which each name has its own slot */
+    std::vector<xml_symbol_entry>   slots;
+
+    /** displacement of each bucket, chosen so that no two names share a slot */
+    std::vector<uint32_t>           displacements;
+
+    /** 32 minus the base 2 logarithm of the number of buckets and of
+        slots, both of which are powers of two */
+    int                             bucket_shift;
+    int                             slot_shift;
+
+    /** true if the whole name is hashed, as some registered names
+        share the characters that are hashed otherwise */
+    bool                            full;
+} xml_symbols;
+
+/**
+    Reduces a name to a 32 bit key for hashing. Unless 'full' is set
+    the key packs the first and last characters of the name with its
+    length, so that names of up to two characters are fully determined
+    by their key.
+
+    @param[in]  str     First character of the name
+    @param[in]  len     Number of characters in the name
+    @param[in]  full    Whether to hash every character
+    @return key of the name
+*/
+static inline uint32_t xml_symbol_key( const char *str, size_t len, bool full ){
+    const unsigned char *s = (const unsigned char*)str;
+    uint32_t key = 0;
+    if( full ){
+        // FNV-1a
+        key = 2166136261u;
+        for( size_t i=0; i<len; i++ )
+            key = (key ^ s[i]) * 16777619u;
+    } else if( len > 0 ){
+        key = (uint32_t)s[0] | (uint32_t)s[len-1] << 8;
+    }
+    return key ^ (uint32_t)len << 16;
+}
+
+/**
+    Returns the bucket of 'key'
+
+    @param[in]  key     Key from xml_symbol_key()
+    @param[in]  shift   xml_symbols::bucket_shift
+    @return bucket index
+*/
+static inline size_t xml_symbol_bucket( uint32_t key, int shift ){
+    return (size_t)((uint32_t)(key * 0x9e3779b1u) >> shift);
+}
+
+/**
+    Returns the slot of 'key' given the displacement of its bucket
+
+    @param[in]  key          Key from xml_symbol_key()
+    @param[in]  displacement Displacement of the key's bucket
+    @param[in]  shift        xml_symbols::slot_shift
+    @return slot index
+*/
+static inline size_t xml_symbol_slot( uint32_t key, uint32_t displacement, int shift ){
+    return (size_t)((uint32_t)((key ^ displacement) * 0x85ebca6bu) >> shift);
+}
+
+/**
+    @brief Orders buckets of names by decreasing size, see xml_place_symbols()
+*/
+struct xml_bucket_larger {
+    /** buckets being ordered */
+    const std::vector< std::vector<int> > *m_buckets;
+
+    xml_bucket_larger( const std::vector< std::vector<int> > *buckets ) : m_buckets(buckets) {}
+
+    inline bool operator()( size_t a, size_t b ) const {
+        return (*m_buckets)[a].size() > (*m_buckets)[b].size();
+    }
+};
+
+/**
+    Searches for a displacement for each bucket of keys which places
+    every key in its own slot of a table of 2^(32-slot_shift) slots,
+    filling in the table if one is found. The largest buckets are
+    placed first, while the table is emptiest.
+
+    @param[in]  symbols     Symbol table holding the names
+    @param[in]  keys        Key of each name
+    @return true if the keys were placed without collisions
+*/
+static inline bool xml_place_symbols( xml_symbols *symbols, const std::vector<uint32_t> &keys ){
+    const size_t bucket_count = symbols->displacements.size();
+    const size_t slot_count = (size_t)1 << (32-symbols->slot_shift);
+    std::vector< std::vector<int> > buckets( bucket_count );
+    for( size_t id=0; id<keys.size(); id++ )
+        buckets[xml_symbol_bucket( keys[id], symbols->bucket_shift )].push_back( (int)id );
+    std::vector<size_t> order( bucket_count );
+    for( size_t i=0; i<bucket_count; i++ )
+        order[i] = i;
+    std::stable_sort( order.begin(), order.end(), xml_bucket_larger( &buckets ) );
+
+    const xml_symbol_entry empty = { 0, ~0u, XML_SYMBOL_UNKNOWN };
+    symbols->slots.assign( slot_count, empty );
+    std::vector<size_t> placed;
+    for( size_t i=0; i<bucket_count && !buckets[order[i]].empty(); i++ ){
+        const std::vector<int> &bucket = buckets[order[i]];
+        uint32_t displacement = 0;
+        for( ;; displacement++ ){
+            if( displacement == (1u << 16) )
+                return false;
+            placed.clear();
+            size_t k = 0;
+            for( ; k<bucket.size(); k++ ){
+                const int id = bucket[k];
+                const size_t slot = xml_symbol_slot( keys[id], displacement, symbols->slot_shift );
+                if( symbols->slots[slot].id != XML_SYMBOL_UNKNOWN )
+                    break;
+                const xml_symbol_entry entry = { keys[id], (uint32_t)symbols->names[id].size(), id };
+                symbols->slots[slot] = entry;
+                placed.push_back( slot );
+            }
+            if( k == bucket.size() )
+                break;
+            for( size_t p=0; p<placed.size(); p++ )
+                symbols->slots[placed[p]] = empty;
+        }
+        symbols->displacements[order[i]] = displacement;
+    }
+    return true;
+}
+
+/**
+    Builds a symbol table for 'count' names, which receive the ids
+    0 to count-1 in the order given.
+
+    @param[in]  symbols Symbol table to fill in
+    @param[in]  names   Null-terminated names to register
+    @param[in]  count   Number of names
+    @return true on success, false if a name is registered twice (or,
+            improbably, two names have the same full hash)
+*/
+static inline bool xml_init_symbols( xml_symbols *symbols, const char *const *names, int count ){
+    symbols->names.assign( names, names+count );
+
+    // hash whole names only if the short keys are not all distinct
+    std::vector<uint32_t> keys( count );
+    for( int pass=0; pass<2; pass++ ){
+        symbols->full = pass == 1;
+        for( int i=0; i<count; i++ )
+            keys[i] = xml_symbol_key( names[i], symbols->names[i].size(), symbols->full );
+        std::vector<uint32_t> sorted( keys );
+        std::sort( sorted.begin(), sorted.end() );
+        if( std::adjacent_find( sorted.begin(), sorted.end() ) == sorted.end() )
+            break;
+        if( pass == 1 )
+            return false;
+    }
+
+    // use about two names per bucket and a table at least twice the
+    // size of the vocabulary, grown if no placement is found
+    symbols->bucket_shift = 31;
+    while( ((size_t)1 << (32-symbols->bucket_shift)) < (size_t)count/2+1 )
+        symbols->bucket_shift--;
+    symbols->slot_shift = 31;
+    while( ((size_t)1 << (32-symbols->slot_shift)) < 2*(size_t)count+1 )
+        symbols->slot_shift--;
+    symbols->displacements.assign( (size_t)1 << (32-symbols->bucket_shift), 0 );
+    while( !xml_place_symbols( symbols, keys ) )
+        symbols->slot_shift--;
+    return true;
+}
+
+/**
+    Looks up the id of 'name'
+
+    @param[in]  symbols Symbol table
+    @param[in]  name    Name to look up
+    @return id of the name, or XML_SYMBOL_UNKNOWN if it is not registered
+*/
+static inline int xml_symbol_id( const xml_symbols *symbols, xml_span name ){
+    const uint32_t key = xml_symbol_key( name.str, name.len, symbols->full );
+    const uint32_t displacement = symbols->displacements[xml_symbol_bucket( key, symbols->bucket_shift )];
+    const xml_symbol_entry &entry = symbols->slots[xml_symbol_slot( key, displacement, symbols->slot_shift )];
+    if( entry.key != key || entry.len != name.len )
+        return XML_SYMBOL_UNKNOWN;
+    // short names are fully determined by the key and length
+    if( name.len <= 2 && !symbols->full )
+        return entry.id;
+    return memcmp( symbols->names[entry.id].data(), name.str, name.len ) == 0 ? entry.id : XML_SYMBOL_UNKNOWN;
+}
+
+/**
+    Returns the name registered as 'id'
+
+    @param[in]  symbols Symbol table
+    @param[in]  id      Id of a registered name
+    @return null-terminated name
+*/
+static inline const char *xml_symbol_name( const xml_symbols *symbols, int id ){
+    return symbols->names[id].c_str();
+}
+
+/**
+    @brief Base class for handlers receiving symbol ids, see
+    xml_symbol_adapter. The events are those of xml_handler with the
+    id of each tag or attribute name (XML_SYMBOL_UNKNOWN for names not
+    in the table) passed before the name itself. As with xml_handler,
+    begin_tag may return bool to skip the tag, and stop_requested()
+    may be defined to stop parsing.
+*/
+class xml_symbol_handler {
+public:
+    /** called whenever a new tag is started */
+    inline void begin_tag( int id, xml_span name ){ (void)id; (void)name; }
+
+    /** called whenever a tag is ended */
+    inline void end_tag( int id, xml_span name ){ (void)id; (void)name; }
+
+    /** called whenever the text for a tag is read */
+    inline void tag_text( xml_span text ){ (void)text; }
+
+    /** called whenever a comment is read */
+    inline void comment( xml_span comment ){ (void)comment; }
+
+    /** called whenever a CDATA section is read */
+    inline void cdata( xml_span text ){ (void)text; }
+
+    /** called whenever a tag attribute is read */
+    inline void attribute( int id, xml_span name, xml_span value ){ (void)id; (void)name; (void)value; }
+    
+    /** called with all attributes of a tag, see xml_handler::attributes() */
+    inline void attributes( int id, xml_span name, const xml_attribute *attributes, size_t count ){ (void)id; (void)name; (void)attributes; (void)count; }
+    
+    /** see xml_handler::batch_attributes() */
+    inline bool batch_attributes(){ return false; }
+
+    /** polled after each event, see xml_handler::stop_requested() */
+    inline bool stop_requested(){ return false; }
+
+    /** see xml_handler::decode_references() */
+    inline bool decode_references(){ return true; }
+};
+
+/**
+    @brief Handler which looks up each tag and attribute name in a
+    symbol table and forwards the events, with the ids, to a handler
+    derived from xml_symbol_handler. Being a template, the lookup and
+    the handler are inlined into the parser. The ids of the open tags
+    are kept on a stack, so each tag name is looked up once and its
+    end_tag and attributes events reuse the id; an adapter therefore
+    reads a single document.
+*/
+template< typename Handler >
+class xml_symbol_adapter : public xml_handler {
+private:
+    /** table in which names are looked up */
+    const xml_symbols   *m_symbols;
+
+    /** handler receiving the events */
+    Handler             &m_handler;
+
+    /** ids of the open tags, innermost last */
+    std::vector<int>    m_open;
+public:
+    /**
+     Builds an adapter looking up names in 'symbols' for 'handler'
+    */
+    xml_symbol_adapter( const xml_symbols *symbols, Handler &handler ) : m_symbols(symbols), m_handler(handler) {}
+
+    /** forwards begin_tag events, and whether to skip the tag */
+    inline bool begin_tag( xml_span name ){
+        const int id = xml_symbol_id( m_symbols, name );
+        m_open.push_back( id );
+        return xml_skip_requested( ( m_handler.begin_tag( id, name ), xml_no_skip() ) );
+    }
+
+    /** forwards end_tag events with the id of the matching begin_tag */
+    inline void end_tag( xml_span name ){
+        const int id = m_open.back();
+        m_open.pop_back();
+        m_handler.end_tag( id, name );
+    }
+
+    /** forwards tag_text events */
+    inline void tag_text( xml_span text ){
+        m_handler.tag_text( text );
+    }
+
+    /** forwards comment events */
+    inline void comment( xml_span comment ){
+        m_handler.comment( comment );
+    }
+
+    /** forwards CDATA events */
+    inline void cdata( xml_span text ){
+        m_handler.cdata( text );
+    }
+
+    /** forwards attribute events */
+    inline void attribute( xml_span name, xml_span value ){
+        m_handler.attribute( xml_symbol_id( m_symbols, name ), name, value );
+    }
+
+    /** forwards batches of attributes with the id of the tag */
+    inline void attributes( xml_span name, const xml_attribute *attributes, size_t count ){
+        m_handler.attributes( m_open.back(), name, attributes, count );
+    }
+    
+    /** batches attributes if the handler does */
+    inline bool batch_attributes(){
+        return m_handler.batch_attributes();
+    }
+    
+    /** forwards the handler's request to stop */
+    inline bool stop_requested(){
+        return m_handler.stop_requested();
+    }
+    
+    /** decodes references unless the handler wants the raw values */
+    inline bool decode_references(){
+        return m_handler.decode_references();
+    }
+};
+
+/**
+ @brief parses the document held in a caller-owned buffer without
+ copying it, see xml_parse(), passing the id of each tag and
+ attribute name in 'symbols' to 'handler' (see xml_symbol_handler)
+
+ @param[in]  buffer  Pointer to the xml data, buffer[size] must be '\0'
+ @param[in]  size    Number of characters in buffer
+ @param[in]  symbols Table of known names
+ @param[in]  handler Handler receiving the parser events
+ @param[out] error   Receives the first error, or NULL to report errors
+ @return true if the document was read without error
+ */
+template< typename Handler >
+inline bool xml_parse_symbols( const char *buffer, size_t size, const xml_symbols *symbols, Handler &handler, xml_error_info *error=NULL ){
+    xml_symbol_adapter<Handler> adapter( symbols, handler );
+    return xml_parse( buffer, size, adapter, error );
+}
+
+#endif